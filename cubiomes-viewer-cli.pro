@@ -0,0 +1,49 @@
+#-------------------------------------------------
+#
+# Command line search driver for cubiomes-viewer sessions,
+# which runs without a display (Qt core only).
+#
+#-------------------------------------------------
+
+QT      += core
+QT      -= gui
+LIBS    += -lm $$PWD/cubiomes/libcubiomes.a
+
+QMAKE_CFLAGS    =  -fwrapv
+QMAKE_CXXFLAGS  =  $$QMAKE_CFLAGS -std=gnu++11
+QMAKE_CXXFLAGS_RELEASE *= -O3
+
+win32: {
+    LIBS += -static -static-libgcc -static-libstdc++
+}
+
+TARGET = cubiomes-viewer-cli
+
+CONFIG += console static
+CONFIG -= app_bundle
+
+
+SOURCES += \
+        src/journal.cpp \
+        src/search.cpp \
+        src/searchitem.cpp \
+        src/searchthread.cpp \
+        src/forecast.cpp \
+        src/session.cpp \
+        src/cli.cpp
+
+HEADERS += \
+        cubiomes/finders.h \
+        cubiomes/generator.h \
+        cubiomes/javarnd.h \
+        cubiomes/layers.h \
+        cubiomes/util.h \
+        src/cutil.h \
+        src/journal.h \
+        src/search.h \
+        src/searchitem.h \
+        src/searchthread.h \
+        src/forecast.h \
+        src/seedtables.h \
+        src/session.h \
+        src/settings.h
@@ -50,6 +50,9 @@ SOURCES += \
         src/search.cpp \
         src/searchitem.cpp \
         src/searchthread.cpp \
+        src/forecast.cpp \
+        src/session.cpp \
+        src/journal.cpp \
         src/mainwindow.cpp \
         src/main.cpp
 
@@ -75,6 +78,9 @@ HEADERS += \
         src/search.h \
         src/searchitem.h \
         src/searchthread.h \
+        src/forecast.h \
+        src/session.h \
+        src/journal.h \
         src/seedtables.h \
         src/mainwindow.h \
         src/settings.h
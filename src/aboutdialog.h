@@ -3,23 +3,7 @@
 
 #include <QDialog>
 
-#define VERS_MAJOR 1
-#define VERS_MINOR 6
-#define VERS_PATCH 1    // negative patch number designates a development version
-
-// returns +1 if newer, -1 if older  and 0 if equal
-inline int cmpVers(int major, int minor, int patch)
-{
-    int s;
-    s = (major > VERS_MAJOR) - (major < VERS_MAJOR);
-    if (s) return s;
-    s = (minor > VERS_MINOR) - (minor < VERS_MINOR);
-    if (s) return s;
-    int p0 = VERS_PATCH >= 0 ? 1000+VERS_PATCH : -VERS_PATCH;
-    int p1 = patch      >= 0 ? 1000+patch      : -patch;
-    s = (p1 > p0) - (p1 < p0);
-    return s;
-}
+#include "settings.h"
 
 namespace Ui {
 class AboutDialog;
@@ -0,0 +1,431 @@
+#include "session.h"
+#include "searchthread.h"
+#include "forecast.h"
+#include "cutil.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTimer>
+#include <QSet>
+
+#include <csignal>
+
+
+static std::atomic_bool g_interrupt;
+
+static void onInterrupt(int)
+{
+    g_interrupt = true;
+}
+
+static bool loadList(QString path, const QDir& dir, std::vector<int64_t>& slist)
+{
+    QByteArray ba = dir.absoluteFilePath(path).toLocal8Bit();
+    int64_t len = 0;
+    int64_t *l = loadSavedSeeds(ba.data(), &len);
+    if (!l)
+        return false;
+    slist.assign(l, l+len);
+    free(l);
+    return len > 0;
+}
+
+static bool updateSession(const Session& session, QString fnam)
+{
+    QFile file(fnam);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    QTextStream stream(&file);
+    session.writeTo(stream);
+    return true;
+}
+
+static void printProfile(const QVector<CondProfile>& prof)
+{
+    double total = 0;
+    for (const CondProfile& p : prof)
+        total += p.nsec;
+    if (prof.empty() || total <= 0)
+        return;
+    fprintf(stderr, "Condition    calls   passed  ns/call   share\n");
+    for (const CondProfile& p : prof)
+    {
+        fprintf(stderr, "[%02d]%-2s %11" PRIu64 " %7.2f%% %8.0f %6.1f%%\n",
+                p.save, p.pass == 0 ? "*" : "", p.calls,
+                p.calls ? 100.0 * p.passed / p.calls : 0.0,
+                p.calls ? p.nsec / p.calls : 0.0, 100.0 * p.nsec / total);
+    }
+    fprintf(stderr, "(* tested with the 48-bit seed)\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    initBiomes();
+
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("cubiomes-viewer-cli");
+    QCoreApplication::setApplicationVersion(QString::asprintf("%d.%d.%d", VERS_MAJOR, VERS_MINOR, VERS_PATCH));
+
+    Config config;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Runs the search of a cubiomes-viewer session file without a graphical interface. "
+        "Matching seeds are written to the output, one per line.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("session", "Session file as written by \"Save progress\".");
+    QCommandLineOption optThreads({"t", "threads"}, "Number of search threads (default: as in session).", "n");
+    QCommandLineOption optOutput({"o", "output"}, "Append matching seeds to this file instead of stdout.", "file");
+    QCommandLineOption optStart({"s", "start"}, "Start seed, overriding the session progress.", "seed");
+    QCommandLineOption optItems({"i", "item-size"}, "Number of seeds per search item (0: auto).", "n", QString::number(config.seedsPerItem));
+    QCommandLineOption optQueue({"q", "queue-size"}, "Size of the search item queue (default: 2x threads).", "n");
+    QCommandLineOption optUpdate({"u", "update"}, "Write the progress and the matching seeds back to the session file.");
+    QCommandLineOption optJournal({"j", "journal"}, "Journal of completed items, which a resumed search skips (default with --update: <session>.journal).", "file");
+    QCommandLineOption optPlan("plan", "Reorder the conditions by measured cost, instead of evaluating them in the given order.");
+    QCommandLineOption optProfile("profile", "Count and time the conditions, print their profile at the end and keep it in the session.");
+    QCommandLineOption optInterval("interval", "Seconds between progress reports and session updates.", "sec", "60");
+    QCommandLineOption optQuery("query", "Also search for the conditions of another session file in the same pass (repeatable). "
+        "The output lines are then \"<seed> <query>\", where query 0 is the session itself.", "file");
+    QCommandLineOption optForecast("forecast", "Instead of searching, test the conditions on random seeds of the search space "
+        "for the given time, and print the estimated pass rates, matches and duration.", "sec");
+    QCommandLineOption optVersions("versions", "Search the conditions for each of these Minecraft versions in one pass, e.g. \"1.15,1.16\". "
+        "The output lines are then \"<seed> <version>\".", "list");
+    QCommandLineOption optText("text", "Append a text to each matching seed that can be entered for it (for seeds of 32 bits).");
+    parser.addOption(optThreads);
+    parser.addOption(optOutput);
+    parser.addOption(optStart);
+    parser.addOption(optItems);
+    parser.addOption(optQueue);
+    parser.addOption(optUpdate);
+    parser.addOption(optJournal);
+    parser.addOption(optPlan);
+    parser.addOption(optProfile);
+    parser.addOption(optInterval);
+    parser.addOption(optQuery);
+    parser.addOption(optVersions);
+    parser.addOption(optText);
+    parser.addOption(optForecast);
+    parser.process(app);
+
+    QStringList args = parser.positionalArguments();
+    if (args.size() != 1)
+        parser.showHelp(1);
+
+    QString fnam = args[0];
+    QFile file(fnam);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        fprintf(stderr, "Failed to open session file: %s\n", fnam.toLocal8Bit().data());
+        return 1;
+    }
+    Session session;
+    QTextStream stream(&file);
+    if (!session.readFrom(stream))
+    {
+        fprintf(stderr, "Failed to parse session file: %s\n", fnam.toLocal8Bit().data());
+        return 1;
+    }
+    file.close();
+    if (cmpVers(session.major, session.minor, session.patch) > 0)
+        fprintf(stderr, "Warning: session file was created with a newer version.\n");
+
+    QVector<int> mcs = { session.mc };
+    bool versions = parser.isSet(optVersions);
+    if (versions)
+    {
+        mcs.clear();
+        for (const QString& v : parser.value(optVersions).split(','))
+        {
+            int mc = str2mc(v.trimmed().toLocal8Bit().data());
+            if (mc < 0 || mcs.contains(mc))
+            {
+                fprintf(stderr, "Error: invalid or repeated version: %s\n", v.toLocal8Bit().data());
+                return 1;
+            }
+            mcs.push_back(mc);
+        }
+        if (parser.isSet(optQuery))
+        {
+            fprintf(stderr, "Error: a search for several versions takes no further queries.\n");
+            return 1;
+        }
+    }
+
+    QString err;
+    QStringList info;
+    bool ok = true;
+    for (int i = 0; ok && i < mcs.size(); i++)
+    {
+        info.clear();
+        ok = checkConditions(session.cv, mcs[i], &err, &info);
+        for (const QString& s : info)
+            if (i == 0) // the remarks do not depend on the version
+                fprintf(stderr, "Info: %s\n", s.toLocal8Bit().data());
+        if (!ok && versions)
+            err = QString(mc2str(mcs[i])) + ": " + err;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error: %s\n", err.toLocal8Bit().data());
+        return 1;
+    }
+    if (session.cv.empty())
+    {
+        fprintf(stderr, "Error: session has no search conditions.\n");
+        return 1;
+    }
+
+    QVector<QVector<Condition>> queries = { session.cv };
+    for (const QString& qnam : parser.values(optQuery))
+    {
+        QFile qfile(qnam);
+        Session qs;
+        QTextStream qstream(&qfile);
+        if (!qfile.open(QIODevice::ReadOnly) || !qs.readFrom(qstream))
+        {
+            fprintf(stderr, "Failed to read query session: %s\n", qnam.toLocal8Bit().data());
+            return 1;
+        }
+        if (qs.mc != session.mc)
+            fprintf(stderr, "Warning: query %d is searched for %s.\n", queries.size(), mc2str(session.mc));
+        info.clear();
+        if (!checkConditions(qs.cv, session.mc, &err, &info) || qs.cv.empty())
+        {
+            fprintf(stderr, "Error: query %d: %s\n", queries.size(),
+                    qs.cv.empty() ? "no search conditions." : err.toLocal8Bit().data());
+            return 1;
+        }
+        queries.push_back(qs.cv);
+    }
+    int qcnt = versions ? mcs.size() : queries.size();
+    bool multiq = qcnt > 1;
+    // the query whose matches belong to the session
+    int sessq = versions ? mcs.indexOf(session.mc) : 0;
+
+    SearchConfig& sc = session.sc;
+    if (parser.isSet(optThreads))
+        sc.threads = parser.value(optThreads).toInt();
+    if (parser.isSet(optStart))
+        sc.startseed = parser.value(optStart).toLongLong();
+    if (sc.threads <= 0)
+        sc.threads = QThread::idealThreadCount();
+    int itemsize = parser.value(optItems).toInt();
+    int queuesize = parser.isSet(optQueue) ? parser.value(optQueue).toInt() : 2 * sc.threads;
+    int interval = parser.value(optInterval).toInt();
+    if (itemsize < 0) itemsize = 0;
+    if (queuesize <= 0) queuesize = sc.threads;
+    if (interval <= 0) interval = 60;
+
+    // list paths are stored relative to the session
+    QDir dir = QFileInfo(fnam).absoluteDir();
+    std::vector<int64_t> slist;
+    Gen48Settings gen48 = session.gen48;
+    if (multiq || versions)
+    {   // the 48-bit candidates can only come from the shared conditions
+        QVector<Condition> merged;
+        std::vector<uint32_t> qmask;
+        std::vector<int> tmc;
+        int shared = 0;
+        ok = versions ? splitVersions(session.cv, mcs, &merged, &shared, &qmask, &tmc, &err)
+                      : mergeQueries(queries, &merged, &shared, &qmask, &err);
+        if (!ok)
+        {
+            fprintf(stderr, "Error: %s\n", err.toLocal8Bit().data());
+            return 1;
+        }
+        resolveGen48Auto(&gen48, merged.mid(0, shared));
+    }
+    else
+    {
+        resolveGen48Auto(&gen48, session.cv);
+    }
+
+    if (sc.searchmode == SEARCH_LIST)
+    {
+        if (!loadList(sc.slist64path, dir, slist))
+        {
+            fprintf(stderr, "Error: failed to load seed list: %s\n", sc.slist64path.toLocal8Bit().data());
+            return 1;
+        }
+    }
+    else if (gen48.mode == GEN48_LIST)
+    {
+        if (!loadList(gen48.slist48path, dir, slist))
+        {
+            fprintf(stderr, "Error: failed to load 48-bit list: %s\n", gen48.slist48path.toLocal8Bit().data());
+            return 1;
+        }
+    }
+
+    QFile out;
+    if (parser.isSet(optOutput))
+    {
+        out.setFileName(parser.value(optOutput));
+        ok = out.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+    else
+    {
+        ok = out.open(stdout, QIODevice::WriteOnly);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error: failed to open output.\n");
+        return 1;
+    }
+
+    signal(SIGINT, onInterrupt);
+    signal(SIGTERM, onInterrupt);
+
+    qRegisterMetaType< int64_t >("int64_t");
+    qRegisterMetaType< uint64_t >("uint64_t");
+    qRegisterMetaType< QVector<int64_t> >("QVector<int64_t>");
+    qRegisterMetaType< QVector<CondProfile> >("QVector<CondProfile>");
+
+    SearchThread sthread;
+    if (versions)
+    {
+        if (!sthread.set(NULL, sc.searchmode, sc.threads, gen48, slist, sc.startseed,
+                         mcs, session.cv, itemsize, queuesize, &err))
+        {
+            fprintf(stderr, "Error: %s\n", err.toLocal8Bit().data());
+            return 1;
+        }
+    }
+    else if (multiq)
+    {
+        if (!sthread.set(NULL, sc.searchmode, sc.threads, gen48, slist, sc.startseed,
+                         session.mc, queries, itemsize, queuesize, &err))
+        {
+            fprintf(stderr, "Error: %s\n", err.toLocal8Bit().data());
+            return 1;
+        }
+    }
+    else if (!sthread.set(NULL, sc.searchmode, sc.threads, gen48, slist, sc.startseed,
+                          session.mc, session.cv, itemsize, queuesize))
+    {
+        return 1;
+    }
+
+    sthread.planconds = config.planConditions || parser.isSet(optPlan);
+    sthread.profconds = config.profileConditions || parser.isSet(optProfile);
+
+    if (parser.isSet(optForecast))
+    {
+        double sec = parser.value(optForecast).toDouble();
+        SearchForecast fc;
+        sthread.itemgen.presearch();
+        runForecast(sthread.itemgen, sc.threads, sec > 0 ? (int)(sec * 1000) : FORECAST_MSEC, &fc);
+        sthread.itemgen.stop();
+        fputs(fc.summary().toLocal8Bit().data(), stdout);
+        return 0;
+    }
+
+    bool update = parser.isSet(optUpdate);
+    if (parser.isSet(optJournal))
+        sthread.journalpath = parser.value(optJournal);
+    else if (update)
+        sthread.journalpath = fnam + ".journal";
+
+    // the journal reports the matches of completed items again on resume
+    QVector<QSet<int64_t>> known(qcnt);
+    for (int64_t s : session.slist)
+        if (sessq >= 0)
+            known[sessq].insert(s);
+    QVector<int64_t> results;   // matches of the session that have not been saved yet
+    int64_t rescnt = 0;
+    uint64_t prog = 0, end = 0;
+    int cursize = 0;     // current item size
+    QVector<CondProfile> prof;
+    int64_t progseed = sc.startseed;
+
+    auto report = [&]() {
+        if (sthread.itemgen.isdone)
+            prog = end;
+        fprintf(stderr, "Progress: %" PRIu64 " / %" PRIu64 " (%.2f%%) seed: %" PRId64 " matches: %" PRId64 " item size: %d\n",
+                prog, end, end ? 100.0 * prog / end : 0.0, progseed, rescnt, cursize);
+        if (update)
+        {
+            sc.startseed = progseed;
+            if (sthread.profconds)
+                session.prof = prof;
+            session.slist += results;
+            results.clear();
+            if (!updateSession(session, fnam))
+                fprintf(stderr, "Warning: failed to update session file.\n");
+        }
+    };
+
+    bool withtext = parser.isSet(optText);
+    auto addResults = [&](int q, const QVector<int64_t>& seeds) {
+        for (int64_t s : seeds)
+        {
+            if (known[q].contains(s))
+                continue;
+            known[q].insert(s);
+            QString line = QString::asprintf("%" PRId64, s);
+            QString text;
+            if (versions && multiq)
+                line += QString(" ") + mc2str(mcs[q]);
+            else if (multiq)
+                line += QString::asprintf(" %d", q);
+            if (withtext && seed2text(s, &text))
+                line += " " + text;
+            out.write((line + "\n").toLatin1());
+            if (q == sessq)
+                results.push_back(s);
+            rescnt++;
+        }
+        out.flush();
+    };
+    QObject::connect(&sthread, &SearchThread::results, &app, [&](QVector<int64_t> seeds, bool) {
+        if (!multiq)
+            addResults(0, seeds);
+    }, Qt::QueuedConnection);
+    QObject::connect(&sthread, &SearchThread::queryResults, &app, [&](int q, QVector<int64_t> seeds) {
+        addResults(q, seeds);
+    }, Qt::QueuedConnection);
+    QObject::connect(&sthread, &SearchThread::progress, &app, [&](uint64_t last, uint64_t total, int64_t seed, int isiz) {
+        cursize = isiz;
+        prog = last;
+        end = total;
+        progseed = seed;
+    }, Qt::QueuedConnection);
+    QObject::connect(&sthread, &SearchThread::conditionOrder, &app, [&](QString desc) {
+        fprintf(stderr, "Condition order - %s\n", desc.toLocal8Bit().data());
+    }, Qt::QueuedConnection);
+    QObject::connect(&sthread, &SearchThread::conditionStats, &app, [&](QVector<CondProfile> p) {
+        prof = p;
+    }, Qt::QueuedConnection);
+    QObject::connect(&sthread, &SearchThread::searchFinish, &app, &QCoreApplication::quit, Qt::QueuedConnection);
+
+    QTimer sigtimer;
+    QObject::connect(&sigtimer, &QTimer::timeout, &app, [&]() {
+        if (g_interrupt && !sthread.abort)
+        {
+            fprintf(stderr, "Interrupted, waiting for active items...\n");
+            sthread.stop();
+        }
+    });
+    sigtimer.start(200);
+
+    QTimer reptimer;
+    QObject::connect(&reptimer, &QTimer::timeout, &app, report);
+    reptimer.start(interval * 1000);
+
+    sthread.start();
+    app.exec();
+    sthread.wait();
+    sthread.pool.waitForDone();
+
+    // deliver what was queued before the finish
+    QCoreApplication::processEvents();
+    report();
+    printProfile(prof);
+
+    return sthread.itemgen.isdone ? 0 : 2;
+}
@@ -10,6 +10,7 @@ ConfigDialog::ConfigDialog(QWidget *parent, Config *config) :
     ui->setupUi(this);
     ui->lineQueueSize->setValidator(new QIntValidator(1, 9999, ui->lineQueueSize));
     ui->lineMatching->setValidator(new QIntValidator(1, 99999999, ui->lineMatching));
+    ui->cboxItemSize->addItem("Auto");
     for (int i = 0; i < 16; i++)
         ui->cboxItemSize->addItem(QString::number(1 << i));
     initSettings(config);
@@ -27,9 +28,14 @@ void ConfigDialog::initSettings(Config *config)
     ui->checkAutosave->setChecked(config->autosaveCycle != 0);
     if (config->autosaveCycle)
         ui->spinAutosave->setValue(config->autosaveCycle);
-    ui->cboxItemSize->setCurrentText(QString::number(config->seedsPerItem));
+    if (config->seedsPerItem > 0)
+        ui->cboxItemSize->setCurrentText(QString::number(config->seedsPerItem));
+    else
+        ui->cboxItemSize->setCurrentIndex(0);
     ui->lineQueueSize->setText(QString::number(config->queueSize));
     ui->lineMatching->setText(QString::number(config->maxMatching));
+    ui->checkPlan->setChecked(config->planConditions);
+    ui->checkProfile->setChecked(config->profileConditions);
 }
 
 Config ConfigDialog::getSettings()
@@ -37,11 +43,13 @@ Config ConfigDialog::getSettings()
     conf.restoreSession = ui->checkRestore->isChecked();
     conf.autosaveCycle = ui->checkAutosave->isChecked() ? ui->spinAutosave->value() : 0;
     conf.smoothMotion = ui->checkSmooth->isChecked();
-    conf.seedsPerItem = ui->cboxItemSize->currentText().toInt();
+    conf.seedsPerItem = ui->cboxItemSize->currentText().toInt(); // "Auto" -> 0
     conf.queueSize = ui->lineQueueSize->text().toInt();
     conf.maxMatching = ui->lineMatching->text().toInt();
+    conf.planConditions = ui->checkPlan->isChecked();
+    conf.profileConditions = ui->checkProfile->isChecked();
 
-    if (!conf.seedsPerItem) conf.seedsPerItem = 1024;
+    if (conf.seedsPerItem < 0) conf.seedsPerItem = 0;
     if (!conf.queueSize) conf.queueSize = QThread::idealThreadCount();
     if (!conf.maxMatching) conf.maxMatching = 65536;
 
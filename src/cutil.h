@@ -126,4 +126,22 @@ inline int str2seed(const QString &str, int64_t *out)
     return S_TEXT;
 }
 
+// Produces a text that str2seed() turns into the given seed, if there is one,
+// i.e. if the seed is a sign-extended 32-bit hash. The hash of seven characters
+// from 'A' to '_' is offset by a base-31 number, which covers 2^32 < 31^7.
+inline bool seed2text(int64_t seed, QString *out)
+{
+    if (seed != (int32_t) seed)
+        return false;
+    uint32_t base = 0;
+    for (int i = 0; i < 7; i++)
+        base = 31 * base + 'A';
+    uint32_t d = (uint32_t) seed - base;
+    char text[7];
+    for (int i = 6; i >= 0; i--, d /= 31)
+        text[i] = 'A' + d % 31;
+    *out = QString::fromLatin1(text, 7);
+    return true;
+}
+
 #endif // CUTIL_H
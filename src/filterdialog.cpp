@@ -266,6 +266,11 @@ FilterDialog::FilterDialog(FormConditions *parent, int mcversion, QListWidgetIte
                 tempsboxes[i]->setValue(cond.temps[i]);
             }
         }
+        if (cond.type == F_STRONGHOLD)
+        {
+            ui->comboStronghold->setCurrentIndex(cond.temps[SH_MODE]);
+            ui->spinStronghold->setValue(cond.temps[SH_ARG]);
+        }
     }
 
     on_lineRadius_editingFinished();
@@ -304,6 +309,13 @@ void FilterDialog::updateMode()
     ui->labelSpinBox->setEnabled(ft.count);
     ui->spinBox->setEnabled(ft.count);
 
+    bool sh = filterindex == F_STRONGHOLD;
+    ui->labelStronghold->setEnabled(sh);
+    ui->comboStronghold->setEnabled(sh);
+    ui->spinStronghold->setEnabled(sh && ui->comboStronghold->currentIndex() != SH_ALL);
+    // the rings count from 0, but there is no first 0
+    ui->spinStronghold->setMinimum(ui->comboStronghold->currentIndex() == SH_FIRST ? 1 : 0);
+
     updateBiomeSelection();
 
     QString loc = "";
@@ -477,6 +489,11 @@ void FilterDialog::on_lineRadius_editingFinished()
     }
 }
 
+void FilterDialog::on_comboStronghold_currentIndexChanged(int)
+{
+    updateMode();
+}
+
 void FilterDialog::on_buttonCancel_clicked()
 {
     close();
@@ -530,6 +547,13 @@ void FilterDialog::on_buttonOk_clicked()
         cond.bfilter = setupBiomeFilter(b, in);
         cond.count = in + ex;
     }
+    if (cond.type == F_STRONGHOLD)
+    {
+        cond.temps[SH_MODE] = ui->comboStronghold->currentIndex();
+        cond.temps[SH_ARG] = ui->spinStronghold->value();
+        if (cond.temps[SH_MODE] == SH_FIRST && cond.temps[SH_ARG] < 1)
+            cond.temps[SH_ARG] = 1;
+    }
     if (ui->tabTemps->isEnabled())
     {
         cond.count = 0;
@@ -85,6 +85,8 @@ private slots:
 
     void on_lineRadius_editingFinished();
 
+    void on_comboStronghold_currentIndexChanged(int);
+
     void on_buttonCancel_clicked();
 
     void on_buttonOk_clicked();
@@ -0,0 +1,234 @@
+#include "forecast.h"
+#include "cutil.h"
+
+#include <cmath>
+
+
+struct ForecastWorker : public QRunnable
+{
+    ForecastWorker(SearchItemGenerator *gen, SearchItem *item, uint64_t rngseed, int msec)
+        : gen(gen),item(item),rngseed(rngseed),msec(msec),samples(),pass48(),matches(),nsec48(),nsecfull(),stats()
+    {
+        setAutoDelete(false);
+    }
+    void run() override;
+
+    SearchItemGenerator *gen;
+    SearchItem *item;       // an item that is never queued, for its condition tests
+    uint64_t rngseed;
+    int msec;
+    int64_t samples, pass48, matches;
+    int64_t nsec48, nsecfull;
+    QVector<CondStat> stats;
+};
+
+void ForecastWorker::run()
+{
+    SearchContext& ctx = getSearchContext();
+    LayerStack *g = ctx.getGenerator(gen->mc);
+    StructPos *spos = ctx.spos;
+    ctx.biomeplan = item->biomeplan;
+    item->setupGenerators(ctx);
+    std::mt19937_64 rng(rngseed);
+    QElapsedTimer timer;
+    timer.start();
+
+    int64_t s;
+    while (timer.elapsed() < msec && !*gen->abort && gen->sampleSeed(rng, &s))
+    {
+        // the two passes are timed separately, as a block search only
+        // makes the 48-bit pass once for all of its 65536 seeds
+        int64_t t0 = timer.nsecsElapsed();
+        bool ok = item->isLowOk((uint32_t) s) &&
+                item->testSeed(spos, s, NULL, true);
+        int64_t t1 = timer.nsecsElapsed();
+        nsec48 += t1 - t0;
+        samples++;
+        if (ok)
+        {
+            pass48++;
+            if (item->testSeed(spos, s, g, false) && item->testQueries(spos, s, g, item->qall, true))
+                matches++;
+            nsecfull += timer.nsecsElapsed() - t1;
+        }
+        // the pass rates of all conditions, as for the planner, on a
+        // stride of the samples
+        if (samples % SearchItem::PROFILE_STRIDE == 0)
+            item->profileSeed(spos, s, g, true);
+    }
+
+    ctx.biomeplan = NULL;
+    stats.swap(item->planstats);
+}
+
+
+// 95% Wilson score interval of k successes in n trials
+static void wilson(int64_t k, int64_t n, double *lo, double *hi)
+{
+    const double z = 1.96;
+    if (n <= 0)
+    {
+        *lo = 0;
+        *hi = 1;
+        return;
+    }
+    double p = (double) k / n;
+    double d = 1 + z*z / n;
+    double c = (p + z*z / (2.0*n)) / d;
+    double w = z * sqrt(p * (1 - p) / n + z*z / (4.0*n*n)) / d;
+    *lo = c - w > 0 ? c - w : 0;
+    *hi = c + w < 1 ? c + w : 1;
+}
+
+void runForecast(SearchItemGenerator& itemgen, int threads, int msec, SearchForecast *fc)
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QElapsedTimer timer;
+    timer.start();
+
+    std::vector<ForecastWorker*> workers;
+    for (int i = 0; i < threads; i++)
+    {
+        SearchItem *item = itemgen.newItem(itemgen.seed, itemgen.idx, 0, 0);
+        item->profile = false;
+        item->planstats.resize(2 * item->ccnt);
+        workers.push_back(new ForecastWorker(&itemgen, item, getRnd64(), msec));
+        pool.start(workers.back());
+    }
+    pool.waitForDone();
+
+    int ccnt = itemgen.ccnt;
+    *fc = SearchForecast();
+    fc->threads = threads;
+    fc->nsec = timer.nsecsElapsed();
+    QVector<CondStat> stats(2 * ccnt);
+    double nsec48 = 0, nsecfull = 0;
+    for (ForecastWorker *w : workers)
+    {
+        fc->samples += w->samples;
+        fc->pass48 += w->pass48;
+        fc->matches += w->matches;
+        nsec48 += w->nsec48;
+        nsecfull += w->nsecfull;
+        for (int i = 0; i < w->stats.size(); i++)
+        {
+            stats[i].calls += w->stats[i].calls;
+            stats[i].passed += w->stats[i].passed;
+        }
+        w->item->searchtype = -1; // not to be reported as canceled
+        delete w->item->range;
+        delete w->item;
+        delete w;
+    }
+
+    uint64_t prog, end;
+    itemgen.getProgress(&prog, &end);
+    fc->remaining = itemgen.isdone ? 0 : (double) end - (double) prog;
+    fc->nsec48 = fc->samples ? nsec48 / fc->samples : 0;
+    fc->nsecfull = fc->pass48 ? nsecfull / fc->pass48 : 0;
+
+    fc->prob[0] = fc->samples ? (double) fc->matches / fc->samples : 0;
+    wilson(fc->matches, fc->samples, &fc->prob[1], &fc->prob[2]);
+    fc->probindep = fc->samples ? (double) fc->pass48 / fc->samples : 0;
+    for (int i = 0; i < ccnt; i++)
+    {
+        int pass = itemgen.orderfull.contains(i) ? 1 : 0;
+        const CondStat& st = stats[pass * ccnt + i];
+        ForecastCond c;
+        c.save = itemgen.cond[i].save;
+        c.pass = pass;
+        c.calls = st.calls;
+        c.passed = st.passed;
+        fc->conds.push_back(c);
+        if (pass == 1 && st.calls)
+            fc->probindep *= (double) st.passed / st.calls;
+    }
+
+    // the time per seed follows from the rate of the 48-bit pass, which is
+    // only made once per block of a block search
+    double p48[3];
+    p48[0] = fc->samples ? (double) fc->pass48 / fc->samples : 0;
+    wilson(fc->pass48, fc->samples, &p48[1], &p48[2]);
+    double t48 = fc->nsec48;
+    if (itemgen.searchtype == SEARCH_BLOCKS)
+        t48 /= 0x10000;
+    for (int i = 0; i < 3; i++)
+    {
+        fc->expected[i] = fc->prob[i] * fc->remaining;
+        // the low speed goes with the high rate
+        double nsps = t48 + p48[i == 0 ? 0 : 3 - i] * fc->nsecfull;
+        fc->speed[i] = nsps > 0 ? threads * 1e9 / nsps : 0;
+        fc->eta[i] = fc->speed[i] > 0 ? fc->remaining / fc->speed[i] : 0;
+    }
+}
+
+
+void ForecastThread::set(int mc, const QVector<Condition>& cv, Gen48Settings gen48, const std::vector<int64_t>& slist,
+                         int searchtype, int64_t sstart, int threads)
+{
+    this->mc = mc;
+    this->condvec = cv;
+    this->gen48 = gen48;
+    this->slist = slist;
+    this->searchtype = searchtype;
+    this->sstart = sstart;
+    this->threads = threads;
+    this->fc = SearchForecast();
+    this->abort = false;
+}
+
+void ForecastThread::run()
+{
+    // there is no window for the protobase messages of the presearch
+    itemgen.abort = &abort;
+    itemgen.init(NULL, mc, condvec.data(), condvec.size(), gen48, slist, 0, searchtype, sstart, threads);
+    itemgen.presearch();
+    if (!abort)
+        runForecast(itemgen, threads, FORECAST_MSEC, &fc);
+    itemgen.stop();
+}
+
+
+static QString formatDuration(double sec)
+{
+    if (sec < 120)
+        return QString::asprintf("%.1f s", sec);
+    if (sec < 7200)
+        return QString::asprintf("%.1f min", sec / 60);
+    if (sec < 2 * 86400)
+        return QString::asprintf("%.1f h", sec / 3600);
+    if (sec < 2 * 365.25 * 86400)
+        return QString::asprintf("%.1f days", sec / 86400);
+    return QString::asprintf("%.3g years", sec / (365.25 * 86400));
+}
+
+QString SearchForecast::summary() const
+{
+    QString s;
+    s += QString::asprintf("Sampled %" PRId64 " seeds in %.1f s with %d threads.\n",
+                           samples, nsec * 1e-9, threads);
+    if (samples == 0)
+        return s + "The search space is empty.\n";
+
+    s += "Condition pass rates (95% range):\n";
+    for (const ForecastCond& c : conds)
+    {
+        double lo, hi;
+        wilson(c.passed, c.calls, &lo, &hi);
+        s += QString::asprintf("  [%02d] %-7s %8.4g%%  (%.4g - %.4g%%)\n", c.save,
+                               c.pass == 0 ? "48-bit" : "full",
+                               c.calls ? 100.0 * c.passed / c.calls : 0.0, 100 * lo, 100 * hi);
+    }
+    s += "  (the full pass only counts the seeds that passed the 48-bit pass)\n";
+    s += QString::asprintf("Matches: %" PRId64 ", probability %.3g  (%.3g - %.3g)\n",
+                           matches, prob[0], prob[1], prob[2]);
+    s += QString::asprintf("  with independent conditions: %.3g\n", probindep);
+    s += QString::asprintf("Remaining seeds: %.4g\n", remaining);
+    s += QString::asprintf("Expected matches: %.3g  (%.3g - %.3g)\n", expected[0], expected[1], expected[2]);
+    if (matches == 0)
+        s += QString::asprintf("  with independent conditions: %.3g\n", probindep * remaining);
+    s += QString::asprintf("Speed: %.3g seeds/s  (%.3g - %.3g)\n", speed[0], speed[1], speed[2]);
+    s += "Time: " + formatDuration(eta[0]) + "  (" + formatDuration(eta[2]) + " - " + formatDuration(eta[1]) + ")\n";
+    return s;
+}
@@ -0,0 +1,74 @@
+#ifndef FORECAST_H
+#define FORECAST_H
+
+#include "searchitem.h"
+
+#include <QThread>
+
+
+// Pass counts of a condition over the sampled seeds, in the pass where it
+// decides (the full pass only sees the seeds that passed the 48-bit pass).
+struct ForecastCond
+{
+    int                 save;       // condition ID
+    int                 pass;       // 0: with the 48-bit seed, 1: with the full seed
+    uint64_t            calls;
+    uint64_t            passed;
+};
+
+// Estimate of the outcome and the duration of a search, from its conditions
+// tested on a random sample of seeds from its search space. The ranges are
+// 95% Wilson score intervals of the sampled proportions, while the measured
+// evaluation times are taken as they are.
+struct SearchForecast
+{
+    int                 threads;
+    int64_t             nsec;       // sampling time
+    int64_t             samples;    // seeds tested
+    int64_t             pass48;     // seeds that passed the 48-bit pass
+    int64_t             matches;
+    double              remaining;  // seeds left in the search space
+    double              nsec48;     // mean time of the 48-bit pass per seed (one thread)
+    double              nsecfull;   // mean time of the full pass per seed that gets to it
+    double              prob[3];    // match probability: estimate, low, high
+    double              probindep;  // the same, as if the conditions were independent
+    double              expected[3]; // matches in the remaining search space
+    double              speed[3];   // seeds per second
+    double              eta[3];     // seconds
+    QVector<ForecastCond> conds;
+
+    QString summary() const;
+};
+
+// default sampling time of a forecast in milliseconds
+#define FORECAST_MSEC   3000
+
+// Tests the conditions of 'itemgen' on random seeds of its search space for
+// about 'msec' milliseconds. The generator has to be set up with presearch().
+void runForecast(SearchItemGenerator& itemgen, int threads, int msec, SearchForecast *fc);
+
+// Sets up a search and makes its forecast in the background, as the
+// presearch alone can take a while. The forecast is valid when the thread
+// finishes without having been aborted.
+struct ForecastThread : QThread
+{
+    ForecastThread() : QThread(),itemgen(),condvec(),gen48(),slist(),mc(),searchtype(),sstart(),threads(),fc(),abort() {}
+
+    void set(int mc, const QVector<Condition>& cv, Gen48Settings gen48, const std::vector<int64_t>& slist,
+             int searchtype, int64_t sstart, int threads);
+    virtual void run() override;
+
+    SearchItemGenerator     itemgen;
+    QVector<Condition>      condvec;
+    Gen48Settings           gen48;
+    std::vector<int64_t>    slist;
+    int                     mc;
+    int                     searchtype;
+    int64_t                 sstart;
+    int                     threads;
+    SearchForecast          fc;         // (out)
+    std::atomic_bool        abort;
+};
+
+
+#endif // FORECAST_H
@@ -33,6 +33,8 @@ FormConditions::FormConditions(MainWindow *parent)
     QFont mono = QFont("Monospace", 9);
     mono.setStyleHint(QFont::TypeWriter);
     ui->listConditionsFull->setFont(mono);
+    ui->tableProfile->setFont(mono);
+    ui->tableProfile->hide();
 }
 
 FormConditions::~FormConditions()
@@ -144,6 +146,10 @@ void FormConditions::setItemCondition(QListWidget *list, QListWidgetItem *item,
         s += QString::asprintf("(%d,%d)", cond->x1*ft.step, cond->z1*ft.step);
     if (ft.area)
         s += QString::asprintf(",(%d,%d)", (cond->x2+1)*ft.step-1, (cond->z2+1)*ft.step-1);
+    if (cond->type == F_STRONGHOLD && cond->temps[SH_MODE] == SH_FIRST)
+        s += QString::asprintf(" first %d", cond->temps[SH_ARG]);
+    else if (cond->type == F_STRONGHOLD && cond->temps[SH_MODE] == SH_RING)
+        s += QString::asprintf(" ring %d", cond->temps[SH_ARG]);
 
     if (ft.cat == CAT_48)
         item->setBackground(QColor(Qt::yellow));
@@ -179,6 +185,7 @@ static void remove_selected(QListWidget *list)
 void FormConditions::on_buttonRemoveAll_clicked()
 {
     ui->listConditionsFull->clear();
+    setProfile(QVector<CondProfile>());
     emit changed();
 }
 
@@ -274,3 +281,53 @@ void FormConditions::on_listConditionsFull_indexesMoved(const QModelIndexList &)
 {
     emit changed();
 }
+
+static QString fmtTime(double nsec)
+{
+    if (nsec < 1e3)
+        return QString::asprintf("%.0f ns", nsec);
+    if (nsec < 1e6)
+        return QString::asprintf("%.1f us", nsec * 1e-3);
+    if (nsec < 1e9)
+        return QString::asprintf("%.1f ms", nsec * 1e-6);
+    return QString::asprintf("%.1f s", nsec * 1e-9);
+}
+
+// Shows the condition counters of a search next to the conditions list.
+void FormConditions::setProfile(QVector<CondProfile> prof)
+{
+    this->prof = prof;
+    QTableWidget *table = ui->tableProfile;
+    table->setRowCount(0);
+    if (prof.empty())
+    {
+        table->hide();
+        return;
+    }
+
+    double total = 0;
+    for (const CondProfile& p : prof)
+        total += p.nsec;
+
+    table->setRowCount(prof.size());
+    for (int i = 0; i < prof.size(); i++)
+    {
+        const CondProfile& p = prof[i];
+        QStringList cells = {
+            QString::asprintf(p.pass == 0 ? "[%02d]*" : "[%02d]", p.save),
+            QString::number(p.calls),
+            p.calls ? QString::asprintf("%.2f%%", 100.0 * p.passed / p.calls) : "-",
+            p.calls ? fmtTime(p.nsec / p.calls) : "-",
+            total > 0 ? QString::asprintf("%.1f%%", 100.0 * p.nsec / total) : "-",
+        };
+        for (int j = 0; j < cells.size(); j++)
+        {
+            QTableWidgetItem *item = new QTableWidgetItem(cells[j]);
+            if (j > 0)
+                item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            table->setItem(i, j, item);
+        }
+    }
+    table->resizeColumnsToContents();
+    table->show();
+}
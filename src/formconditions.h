@@ -23,6 +23,7 @@ public:
     ~FormConditions();
 
     QVector<Condition> getConditions() const;
+    QVector<CondProfile> getProfile() const { return prof; }
     void updateSensitivity();
     int getIndex(int idx) const;
 
@@ -43,6 +44,7 @@ public slots:
     void on_listConditionsFull_itemSelectionChanged();
 
     void addItemCondition(QListWidgetItem *item, Condition cond);
+    void setProfile(QVector<CondProfile> prof);
 
 private slots:
     void on_listConditionsFull_indexesMoved(const QModelIndexList &indexes);
@@ -50,6 +52,7 @@ private slots:
 private:
     MainWindow *parent;
     Ui::FormConditions *ui;
+    QVector<CondProfile> prof;  // condition counters of the last search
 };
 
 #endif // FORMCONDITIONS_H
@@ -3,12 +3,15 @@
 
 #include "mainwindow.h"
 #include "search.h"
+#include "cutil.h"
 
 #include <QMessageBox>
 #include <QMenu>
 #include <QAction>
 #include <QClipboard>
 #include <QFileDialog>
+#include <QStandardPaths>
+#include <QDir>
 #include <QMessageBox>
 
 
@@ -16,10 +19,12 @@ FormSearchControl::FormSearchControl(MainWindow *parent)
     : QWidget(parent)
     , parent(parent)
     , ui(new Ui::FormSearchControl)
-    , sthread(this)
+    , sthread()
+    , fthread()
     , stimer()
     , slist64path()
     , slist64()
+    , resumestart()
 {
     ui->setupUi(this);
 
@@ -28,9 +33,12 @@ FormSearchControl::FormSearchControl(MainWindow *parent)
     ui->listResults->setFont(mono);
     ui->progressBar->setFont(mono);
 
-    //connect(&sthread, &SearchThread::results, this, &MainWindow::searchResultsAdd, Qt::BlockingQueuedConnection);
+    connect(&sthread, &SearchThread::results, this, &FormSearchControl::searchResultsAdd, Qt::QueuedConnection);
     connect(&sthread, &SearchThread::progress, this, &FormSearchControl::searchProgress, Qt::QueuedConnection);
     connect(&sthread, &SearchThread::searchFinish, this, &FormSearchControl::searchFinish, Qt::QueuedConnection);
+    connect(&sthread, &SearchThread::conditionOrder, this, &FormSearchControl::searchPlan, Qt::QueuedConnection);
+    connect(&sthread, &SearchThread::conditionStats, this, &FormSearchControl::searchProfile, Qt::QueuedConnection);
+    connect(&fthread, &QThread::finished, this, &FormSearchControl::forecastFinish, Qt::QueuedConnection);
 
     connect(&stimer, &QTimer::timeout, this, QOverload<>::of(&FormSearchControl::resultTimeout));
     stimer.start(500);
@@ -40,6 +48,7 @@ FormSearchControl::FormSearchControl(MainWindow *parent)
     ui->spinThreads->setValue(QThread::idealThreadCount());
 
     searchLockUi(false);
+    ui->labelPlan->setVisible(false);
 }
 
 FormSearchControl::~FormSearchControl()
@@ -48,6 +57,8 @@ FormSearchControl::~FormSearchControl()
     sthread.stop(); // tell search to stop at next convenience
     sthread.quit(); // tell the event loop to exit
     sthread.wait(); // wait for search to finish
+    fthread.abort = true;
+    fthread.wait();
     delete ui;
 }
 
@@ -76,7 +87,7 @@ SearchConfig FormSearchControl::getSearchConfig()
 bool FormSearchControl::setSearchConfig(SearchConfig s, bool quiet)
 {
     bool ok = true;
-    if (s.searchmode >= SEARCH_INC && s.searchmode <= SEARCH_LIST)
+    if (s.searchmode >= SEARCH_INC && s.searchmode <= SEARCH_TEXT)
         ui->comboSearchType->setCurrentIndex(s.searchmode);
     else
         ok = false;
@@ -90,7 +101,7 @@ bool FormSearchControl::setSearchConfig(SearchConfig s, bool quiet)
 
 bool FormSearchControl::isbusy()
 {
-    return ui->buttonStart->isChecked() || sthread.isRunning();
+    return ui->buttonStart->isChecked() || sthread.isRunning() || fthread.isRunning();
 }
 
 bool FormSearchControl::setList64(QString path, bool quiet)
@@ -126,6 +137,7 @@ void FormSearchControl::searchLockUi(bool lock)
     {
         ui->comboSearchType->setEnabled(false);
         ui->spinThreads->setEnabled(false);
+        ui->buttonForecast->setEnabled(false);
     }
     else
     {
@@ -135,6 +147,7 @@ void FormSearchControl::searchLockUi(bool lock)
         ui->buttonStart->setEnabled(true);
         ui->comboSearchType->setEnabled(true);
         ui->spinThreads->setEnabled(true);
+        ui->buttonForecast->setEnabled(true);
     }
     emit searchStatusChanged(lock);
 }
@@ -154,11 +167,17 @@ void FormSearchControl::setSearchMode(int mode)
 }
 
 
+void FormSearchControl::setResumeJournal()
+{
+    resumestart = ui->lineStart->text();
+}
+
 void FormSearchControl::on_buttonClear_clicked()
 {
     ui->listResults->clearContents();
     ui->listResults->setRowCount(0);
     searchProgressReset();
+    resumestart.clear();
 }
 
 void FormSearchControl::on_buttonStart_clicked()
@@ -190,6 +209,17 @@ void FormSearchControl::on_buttonStart_clicked()
             ok = false;
         }
 
+        if (ok)
+        {
+            QString err;
+            QStringList info;
+            ok = checkConditions(condvec, mc, &err, &info);
+            for (const QString& s : info)
+                QMessageBox::information(this, "Info", s);
+            if (!ok)
+                QMessageBox::warning(this, "Warning", err);
+        }
+
         if (ok)
         {
             Gen48Settings gen48 = parent->formGen48->getSettings(true);
@@ -202,6 +232,20 @@ void FormSearchControl::on_buttonStart_clicked()
                 slist.clear();
 
             ok = sthread.set(parent, searchtype, threads, gen48, slist, sstart, mc, condvec, config.seedsPerItem, config.queueSize);
+
+            // keep track of completed items, so a restored session can skip
+            // them, while any other search starts a new journal
+            QString path = QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation);
+            sthread.journalpath.clear();
+            if (config.restoreSession && QDir().mkpath(path))
+            {
+                sthread.journalpath = path + "/search.journal";
+                if (resumestart.isEmpty() || resumestart != ui->lineStart->text())
+                    QFile::remove(sthread.journalpath);
+            }
+            resumestart.clear();
+            sthread.planconds = config.planConditions;
+            sthread.profconds = config.profileConditions;
         }
 
         if (ok)
@@ -209,6 +253,7 @@ void FormSearchControl::on_buttonStart_clicked()
             ui->lineStart->setText(QString::asprintf("%" PRId64, sstart));
             ui->buttonStart->setText("Abort search");
             ui->buttonStart->setIcon(QIcon(":/icons/cancel.png"));
+            ui->labelPlan->setVisible(false);
             sthread.start();
             searchLockUi(true);
         }
@@ -233,6 +278,64 @@ void FormSearchControl::on_buttonStart_clicked()
     update();
 }
 
+void FormSearchControl::on_buttonForecast_clicked()
+{
+    if (fthread.isRunning())
+    {
+        fthread.abort = true;
+        // disable until finish
+        ui->buttonForecast->setEnabled(false);
+        return;
+    }
+
+    int mc = MC_1_16;
+    parent->getSeed(&mc, NULL);
+    const QVector<Condition>& condvec = parent->formCond->getConditions();
+    int64_t sstart = (int64_t) ui->lineStart->text().toLongLong();
+    int searchtype = ui->comboSearchType->currentIndex();
+    int threads = ui->spinThreads->value();
+
+    if (condvec.empty())
+    {
+        QMessageBox::warning(this, "Warning", "Please define some constraints using the \"Add\" button.", QMessageBox::Ok);
+        return;
+    }
+    if (searchtype == SEARCH_LIST && slist64.empty())
+    {
+        QMessageBox::warning(this, "Warning", "No seed list file selected.", QMessageBox::Ok);
+        return;
+    }
+    QString err;
+    QStringList info;
+    if (!checkConditions(condvec, mc, &err, &info))
+    {
+        QMessageBox::warning(this, "Warning", err);
+        return;
+    }
+
+    Gen48Settings gen48 = parent->formGen48->getSettings(true);
+    std::vector<int64_t> list;
+    if (searchtype == SEARCH_LIST)
+        list = slist64;
+    else if (gen48.mode == GEN48_LIST)
+        list = parent->formGen48->getList48();
+
+    fthread.set(mc, condvec, gen48, list, searchtype, sstart, threads);
+    ui->buttonForecast->setText("Abort forecast");
+    ui->buttonStart->setEnabled(false);
+    ui->comboSearchType->setEnabled(false);
+    ui->spinThreads->setEnabled(false);
+    fthread.start();
+}
+
+void FormSearchControl::forecastFinish()
+{
+    ui->buttonForecast->setText("Forecast");
+    searchLockUi(false);
+    if (!fthread.abort)
+        QMessageBox::information(this, "Search forecast", "<pre>" + fthread.fc.summary().toHtmlEscaped() + "</pre>", QMessageBox::Ok);
+}
+
 void FormSearchControl::on_buttonLoadList_clicked()
 {
     QString fnam = QFileDialog::getOpenFileName(this, "Load seed list", parent->prevdir, "Text files (*.txt);;Any files (*)");
@@ -277,6 +380,10 @@ void FormSearchControl::on_buttonSearchHelp_clicked()
             "<p>Load a <span style=\" font-weight:600;\">seed list from a file</span> to search through an existing set of seeds. "
             "The seeds should be in decimal ASCII text, separated by newline characters. "
             "You can browse for a file using the &quot;...&quot; button. (The seed generator is ignored with this option.)"
+            "</p><p>The <span style=\" font-weight:600;\">text seeds</span> are the seeds that can be entered as text, "
+            "which are the 2<sup>32</sup> values of a 32-bit hash. The search goes through them in the order of the hash, "
+            "or through the 48-bit candidates of the seed generator that are text seeds. "
+            "The tooltip of a matching seed shows a text for it."
             "</p></body></html>"
             ;
     QMessageBox::information(this, "Help: search types", msg, QMessageBox::Ok);
@@ -355,6 +462,9 @@ int FormSearchControl::searchResultsAdd(QVector<int64_t> seeds, bool countonly)
         s48item->setText(QString::asprintf("%012llx|%04x",
                 (qulonglong)(s & MASK48), (uint)(s >> 48) & 0xffff));
         seeditem->setData(Qt::DisplayRole, QVariant::fromValue(s));
+        QString text;
+        if (seed2text(s, &text))
+            seeditem->setToolTip("Text seed: " + text);
         ui->listResults->insertRow(n);
         ui->listResults->setItem(n, 0, s48item);
         ui->listResults->setItem(n, 1, seeditem);
@@ -398,7 +508,7 @@ void FormSearchControl::searchProgressReset()
     ui->progressBar->setFormat(fmt);
 }
 
-void FormSearchControl::searchProgress(uint64_t last, uint64_t end, int64_t seed)
+void FormSearchControl::searchProgress(uint64_t last, uint64_t end, int64_t seed, int itemsize)
 {
 //    if (sthread.itemgen.searchtype == SEARCH_BLOCKS)
 //        seed &= MASK48;
@@ -410,6 +520,8 @@ void FormSearchControl::searchProgress(uint64_t last, uint64_t end, int64_t seed
         ui->progressBar->setValue(v);
         QString fmt = QString::asprintf(
                     "%" PRIu64 " / %" PRIu64 " (%d.%02d%%)", last, end, v / 100, v % 100);
+        if (itemsize > 0)
+            fmt += QString::asprintf(" [item: %d]", itemsize);
         if (!slist64path.isEmpty() && ui->comboSearchType->currentIndex() == SEARCH_LIST)
             fmt = slist64path + ": " + fmt;
         ui->progressBar->setFormat(fmt);
@@ -420,7 +532,7 @@ void FormSearchControl::searchFinish()
 {
     if (!sthread.abort)
     {
-        searchProgress(0, 0, sthread.itemgen.seed);
+        searchProgress(0, 0, sthread.progseed);
     }
     if (sthread.itemgen.isdone)
     {
@@ -430,6 +542,12 @@ void FormSearchControl::searchFinish()
     searchLockUi(false);
 }
 
+void FormSearchControl::searchPlan(QString desc)
+{
+    ui->labelPlan->setText("Condition order - " + desc);
+    ui->labelPlan->setVisible(true);
+}
+
 void FormSearchControl::resultTimeout()
 {
     update();
@@ -5,6 +5,7 @@
 #include <QTimer>
 
 #include "searchthread.h"
+#include "forecast.h"
 #include "protobasedialog.h"
 #include "settings.h"
 
@@ -33,15 +34,20 @@ public:
     void searchLockUi(bool lock);
 
     void setSearchMode(int mode);
+    // lets the next search continue the restored session, skipping the items
+    // that the journal of its previous run has completed
+    void setResumeJournal();
 
 signals:
     void selectedSeedChanged(int64_t seed);
     void searchStatusChanged(bool running);
     void resultsAdded(int cnt);
+    void searchProfile(QVector<CondProfile> prof); // condition counters of the running search
 
 public slots:
     void on_buttonClear_clicked();
     void on_buttonStart_clicked();
+    void on_buttonForecast_clicked();
     void on_buttonLoadList_clicked();
 
     void on_listResults_itemSelectionChanged();
@@ -55,8 +61,10 @@ public slots:
     int pasteList(bool dummy);
     int searchResultsAdd(QVector<int64_t> seeds, bool countonly);
     void searchProgressReset();
-    void searchProgress(uint64_t last, uint64_t end, int64_t seed);
+    void searchProgress(uint64_t last, uint64_t end, int64_t seed, int itemsize = 0);
     void searchFinish();
+    void forecastFinish();
+    void searchPlan(QString desc);
     void resultTimeout();
     void removeCurrent();
     void copyResults();
@@ -65,6 +73,7 @@ private:
     MainWindow *parent;
     Ui::FormSearchControl *ui;
     SearchThread sthread;
+    ForecastThread fthread;
     QTimer stimer;
 
     // the seed list option is not stored in a widget but is loaded with the "..." button
@@ -73,6 +82,9 @@ private:
 
     // buffer for seed candidates while search is running
     std::vector<int64_t> slist;
+
+    // start seed of a restored session whose journal may be replayed (empty: none)
+    QString resumestart;
 };
 
 #endif // FORMSEARCHCONTROL_H
@@ -0,0 +1,136 @@
+#include "journal.h"
+#include "searchitem.h"
+
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t*) data;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t SearchJournal::searchKey(const SearchItemGenerator& itemgen)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = fnv1a(h, &itemgen.searchtype, sizeof(itemgen.searchtype));
+    h = fnv1a(h, &itemgen.mc, sizeof(itemgen.mc));
+    h = fnv1a(h, itemgen.cond, itemgen.ccnt * sizeof(Condition));
+    if (itemgen.qcnt > 1 || itemgen.tcnt > 0)
+    {
+        h = fnv1a(h, &itemgen.qcnt, sizeof(itemgen.qcnt));
+        h = fnv1a(h, itemgen.cond + itemgen.ccnt, itemgen.tcnt * sizeof(Condition));
+        h = fnv1a(h, itemgen.qmask.data(), itemgen.qmask.size() * sizeof(uint32_t));
+        h = fnv1a(h, itemgen.tmc.data(), itemgen.tmc.size() * sizeof(int));
+    }
+    h = fnv1a(h, itemgen.slist.data(), itemgen.slist.size() * sizeof(int64_t));
+    return h;
+}
+
+// add the range [first, last] to the set of ranges, merging overlaps
+static void addRange(std::map<uint64_t, uint64_t> *done, uint64_t first, uint64_t last)
+{
+    auto it = done->upper_bound(first);
+    if (it != done->begin())
+    {
+        auto prev = std::prev(it);
+        if (prev->second >= first || prev->second + 1 == first)
+        {
+            first = prev->first;
+            if (prev->second > last)
+                last = prev->second;
+            it = done->erase(prev);
+        }
+    }
+    while (it != done->end() && (it->first <= last || it->first == last + 1))
+    {
+        if (it->second > last)
+            last = it->second;
+        it = done->erase(it);
+    }
+    (*done)[first] = last;
+}
+
+bool SearchJournal::open(QString path, uint64_t key,
+                         std::map<uint64_t, uint64_t> *done, QVector<int64_t> *results,
+                         QVector<uint32_t> *queries)
+{
+    close();
+    file.setFileName(path);
+
+    bool match = false;
+    if (file.open(QIODevice::ReadOnly))
+    {
+        QList<QByteArray> lines = file.readAll().split('\n');
+        file.close();
+        // the last line is incomplete (or empty) as lines are terminated
+        lines.removeLast();
+
+        uint64_t k;
+        if (!lines.empty() && sscanf(lines[0].data(), "#Journal: %" PRIx64, &k) == 1 && k == key)
+        {
+            match = true;
+            for (int i = 1; i < lines.size(); i++)
+            {
+                QList<QByteArray> v = lines[i].split(' ');
+                if (v.size() < 2)
+                    continue;
+                bool ok0, ok1;
+                uint64_t first = v[0].toULongLong(&ok0);
+                uint64_t last = v[1].toULongLong(&ok1);
+                if (!ok0 || !ok1 || last < first)
+                    continue;
+                addRange(done, first, last);
+                for (int j = 2; j < v.size(); j++)
+                {
+                    QList<QByteArray> m = v[j].split(':');
+                    results->push_back(m[0].toLongLong());
+                    if (m.size() > 1)
+                        queries->push_back(m[1].toUInt(NULL, 16));
+                }
+            }
+        }
+    }
+
+    if (match)
+        return file.open(QIODevice::WriteOnly | QIODevice::Append);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    file.write(QString::asprintf("#Journal: %016" PRIx64 "\n", key).toLatin1());
+    file.flush();
+    return true;
+}
+
+void SearchJournal::append(uint64_t first, uint64_t last, const QVector<int64_t>& matches,
+                           const QVector<uint32_t>& queries)
+{
+    if (!file.isOpen())
+        return;
+    QByteArray line = QString::asprintf("%" PRIu64 " %" PRIu64, first, last).toLatin1();
+    for (int i = 0; i < matches.size(); i++)
+    {
+        line += QString::asprintf(" %" PRId64, matches[i]).toLatin1();
+        if (i < queries.size())
+            line += QString::asprintf(":%x", queries[i]).toLatin1();
+    }
+    line += '\n';
+    file.write(line);
+    file.flush();
+}
+
+void SearchJournal::close()
+{
+    if (file.isOpen())
+        file.close();
+}
+
+void SearchJournal::remove()
+{
+    close();
+    if (!file.fileName().isEmpty())
+        file.remove();
+}
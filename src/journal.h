@@ -0,0 +1,43 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <QFile>
+#include <QVector>
+
+#include <map>
+
+struct SearchItemGenerator;
+
+
+// Append-only record of the item ranges of a search that have completed, with
+// the matching seeds found in them. The progress seed of a session only
+// covers the items that completed in order, so the journal is what allows a
+// resumed search to skip the work that was done out of order.
+//
+// Format: a header line "#Journal: <key>" followed by one line per item:
+// "<first> <last> <match>..." where [first, last] is the range of search
+// space positions (see SearchItemGenerator::getPos). The matches of a
+// multi-query search are written as "<seed>:<queries>", with a hex mask.
+struct SearchJournal
+{
+    SearchJournal() : file() {}
+
+    // Identifies the search space and the conditions of a search.
+    static uint64_t searchKey(const SearchItemGenerator& itemgen);
+
+    // Opens the journal for a search. The ranges and results of an existing
+    // journal are loaded if it belongs to the same search, otherwise the
+    // journal is restarted.
+    bool open(QString path, uint64_t key,
+              std::map<uint64_t, uint64_t> *done, QVector<int64_t> *results,
+              QVector<uint32_t> *queries);
+    void append(uint64_t first, uint64_t last, const QVector<int64_t>& matches,
+                const QVector<uint32_t>& queries);
+    void close();
+    void remove();
+
+    QFile file;
+};
+
+
+#endif // JOURNAL_H
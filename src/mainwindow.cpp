@@ -9,6 +9,7 @@
 
 #include "quad.h"
 #include "cutil.h"
+#include "session.h"
 
 #include <QIntValidator>
 #include <QMetaType>
@@ -22,7 +23,6 @@
 #include <QTextStream>
 #include <QSettings>
 #include <QTreeWidget>
-#include <QDateTime>
 #include <QStandardPaths>
 
 
@@ -63,6 +63,7 @@ MainWindow::MainWindow(QWidget *parent)
     ui->collapseControl->init("Matching seeds", formControl, false);
     connect(formControl, &FormSearchControl::selectedSeedChanged, this, &MainWindow::onSelectedSeedChanged);
     connect(formControl, &FormSearchControl::searchStatusChanged, this, &MainWindow::onSearchStatusChanged);
+    connect(formControl, &FormSearchControl::searchProfile, formCond, &FormConditions::setProfile);
 
 
     this->update();
@@ -105,6 +106,7 @@ MainWindow::MainWindow(QWidget *parent)
     qRegisterMetaType< uint64_t >("uint64_t");
     qRegisterMetaType< QVector<int64_t> >("QVector<int64_t>");
     qRegisterMetaType< Config >("Config");
+    qRegisterMetaType< QVector<CondProfile> >("QVector<CondProfile>");
 
     QIntValidator *intval = new QIntValidator(this);
     ui->lineRadius->setValidator(intval);
@@ -199,6 +201,8 @@ void MainWindow::saveSettings()
     settings.setValue("config/seedsPerItem", config.seedsPerItem);
     settings.setValue("config/queueSize", config.queueSize);
     settings.setValue("config/maxMatching", config.maxMatching);
+    settings.setValue("config/planConditions", config.planConditions);
+    settings.setValue("config/profileConditions", config.profileConditions);
 
     int mc = MC_1_16;
     int64_t seed = 0;
@@ -232,6 +236,8 @@ void MainWindow::loadSettings()
     config.seedsPerItem = settings.value("config/seedsPerItem", config.seedsPerItem).toInt();
     config.queueSize = settings.value("config/queueSize", config.queueSize).toInt();
     config.maxMatching = settings.value("config/maxMatching", config.maxMatching).toInt();
+    config.planConditions = settings.value("config/planConditions", config.planConditions).toBool();
+    config.profileConditions = settings.value("config/profileConditions", config.profileConditions).toBool();
 
     ui->mapView->setSmoothMotion(config.smoothMotion);
 
@@ -263,7 +269,8 @@ void MainWindow::loadSettings()
     if (config.restoreSession)
     {
         QString path = QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation);
-        loadProgress(path + "/session.save", true);
+        if (loadProgress(path + "/session.save", true))
+            formControl->setResumeJournal();
     }
 
     if (config.autosaveCycle > 0)
@@ -288,47 +295,16 @@ bool MainWindow::saveProgress(QString fnam, bool quiet)
         return false;
     }
 
-    SearchConfig searchconf = formControl->getSearchConfig();
-    Gen48Settings gen48 = formGen48->getSettings(false);
-    QVector<Condition> condvec = formCond->getConditions();
-    QVector<int64_t> results = formControl->getResults();
-
-    int mc = MC_1_16;
-    getSeed(&mc, 0);
+    Session session;
+    session.sc = formControl->getSearchConfig();
+    session.gen48 = formGen48->getSettings(false);
+    session.cv = formCond->getConditions();
+    session.slist = formControl->getResults();
+    session.prof = formCond->getProfile();
+    getSeed(&session.mc, 0);
 
     QTextStream stream(&file);
-    stream << "#Version:  " << VERS_MAJOR << "." << VERS_MINOR << "." << VERS_PATCH << "\n";
-    stream << "#Time:     " << QDateTime::currentDateTime().toString() << "\n";
-    // MC version of the session should take priority over the one in the settings
-    stream << "#MC:       " << mc2str(mc) << "\n";
-
-    stream << "#Search:   " << searchconf.searchmode << "\n";
-    if (!searchconf.slist64path.isEmpty())
-        stream << "#List64:   " << searchconf.slist64path.replace("\n", "") << "\n";
-    stream << "#Progress: " << searchconf.startseed << "\n";
-    stream << "#Threads:  " << searchconf.threads << "\n";
-    stream << "#ResStop:  " << (int)searchconf.stoponres << "\n";
-
-    stream << "#Mode48:   " << gen48.mode << "\n";
-    if (!gen48.slist48path.isEmpty())
-        stream << "#List48:   " << gen48.slist48path.replace("\n", "") << "\n";
-    stream << "#HutQual:  " << gen48.qual << "\n";
-    stream << "#MonArea:  " << gen48.qmarea << "\n";
-    if (gen48.salt != 0)
-        stream << "#Salt:     " << gen48.salt << "\n";
-    if (gen48.manualarea)
-    {
-        stream << "#Gen48X1:  " << gen48.x1 << "\n";
-        stream << "#Gen48Z1:  " << gen48.z1 << "\n";
-        stream << "#Gen48X2:  " << gen48.x2 << "\n";
-        stream << "#Gen48Z2:  " << gen48.z2 << "\n";
-    }
-
-    for (Condition &c : condvec)
-        stream << "#Cond: " << QByteArray((const char*) &c, sizeof(Condition)).toHex() << "\n";
-
-    for (int64_t s : results)
-        stream << QString::asprintf("%" PRId64 "\n", s);
+    session.writeTo(stream);
 
     return true;
 }
@@ -344,88 +320,34 @@ bool MainWindow::loadProgress(QString fnam, bool quiet)
         return false;
     }
 
-    int major = 0, minor = 0, patch = 0;
-    SearchConfig searchconf = formControl->getSearchConfig();
-    Gen48Settings gen48 = formGen48->getSettings(false);
-    QVector<Condition> condvec;
-    QVector<int64_t> seeds;
+    Session session;
+    session.sc = formControl->getSearchConfig();
+    session.gen48 = formGen48->getSettings(false);
 
-    char buf[4096];
-    int tmp;
-    int mc = MC_1_16;
     int64_t seed;
-    getSeed(&mc, &seed, true);
+    getSeed(&session.mc, &seed, true);
 
     QTextStream stream(&file);
-    QString line;
-    line = stream.readLine();
-    if (sscanf(line.toLatin1().data(), "#Version: %d.%d.%d", &major, &minor, &patch) != 3)
+    if (!session.readFrom(stream))
         return false;
-    if (cmpVers(major, minor, patch) > 0 && !quiet)
+    if (cmpVers(session.major, session.minor, session.patch) > 0 && !quiet)
         warning("Warning", "Progress file was created with a newer version.");
 
-    while (stream.status() == QTextStream::Ok)
-    {
-        line = stream.readLine();
-        QByteArray ba = line.toLatin1();
-        const char *p = ba.data();
-
-        if (line.isEmpty())
-            break;
-
-        if (line.startsWith("#Time:")) continue;
-        else if (sscanf(p, "#MC:       %8[^\n]", buf) == 1)                     { mc = str2mc(buf); if (mc < 0) return false; }
-        // SearchConfig
-        else if (sscanf(p, "#Search:   %d", &searchconf.searchmode) == 1)       {}
-        else if (sscanf(p, "#Progress: %" PRId64, &searchconf.startseed) == 1)  {}
-        else if (sscanf(p, "#Threads:  %d", &searchconf.threads) == 1)          {}
-        else if (sscanf(p, "#ResStop:  %d", &tmp) == 1)                         { searchconf.stoponres = tmp; }
-        else if (line.startsWith("#List64:   "))                                { searchconf.slist64path = line.mid(11).trimmed(); }
-        // Gen48Settings
-        else if (sscanf(p, "#Mode48:   %d", &gen48.mode) == 1)                  {}
-        else if (sscanf(p, "#HutQual:  %d", &gen48.qual) == 1)                  {}
-        else if (sscanf(p, "#MonArea:  %d", &gen48.qmarea) == 1)                {}
-        else if (sscanf(p, "#Salt:     %" PRId64, &gen48.salt) == 1)            {}
-        else if (sscanf(p, "#Gen48X1:  %d", &gen48.x1) == 1)                    { gen48.manualarea = true; }
-        else if (sscanf(p, "#Gen48Z1:  %d", &gen48.z1) == 1)                    { gen48.manualarea = true; }
-        else if (sscanf(p, "#Gen48X2:  %d", &gen48.x2) == 1)                    { gen48.manualarea = true; }
-        else if (sscanf(p, "#Gen48Z2:  %d", &gen48.z2) == 1)                    { gen48.manualarea = true; }
-        else if (line.startsWith("#List48:   "))                                { gen48.slist48path = line.mid(11).trimmed(); }
-        // Conditions
-        else if (line.startsWith("#Cond:"))
-        {
-            QString hex = line.mid(6).trimmed();
-            QByteArray ba = QByteArray::fromHex(QByteArray(hex.toLatin1().data()));
-            if (ba.size() == sizeof(Condition))
-            {
-                Condition c = *(Condition*) ba.data();
-                condvec.push_back(c);
-            }
-            else return false;
-        }
-        else
-        {
-            int64_t s;
-            if (sscanf(line.toLatin1().data(), "%" PRId64, &s) == 1)
-                seeds.push_back(s);
-            else return false;
-        }
-    }
-
-    setSeed(mc, seed);
+    setSeed(session.mc, seed);
 
     formControl->on_buttonClear_clicked();
-    formControl->searchResultsAdd(seeds, false);
-    formControl->setSearchConfig(searchconf, quiet);
+    formControl->searchResultsAdd(session.slist, false);
+    formControl->setSearchConfig(session.sc, quiet);
 
-    formGen48->setSettings(gen48, quiet);
+    formGen48->setSettings(session.gen48, quiet);
 
     formCond->on_buttonRemoveAll_clicked();
-    for (Condition &c : condvec)
+    for (Condition &c : session.cv)
     {
         QListWidgetItem *item = new QListWidgetItem();
         formCond->addItemCondition(item, c);
     }
+    formCond->setProfile(session.prof);
 
     return true;
 }
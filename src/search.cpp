@@ -1,12 +1,12 @@
 #include "search.h"
 #include "seedtables.h"
-#include "mainwindow.h"
 
 #include <QThread>
 
 #include <algorithm>
-
-extern MainWindow *gMainWindowInstance;
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 
 static bool intersectLineLine(double ax1, double az1, double ax2, double az2, double bx1, double bz1, double bx2, double bz2)
@@ -41,36 +41,1030 @@ static bool intersectRectLine(double rx1, double rz1, double rx2, double rz2, do
     return false;
 }
 
-static bool isInnerRingOk(int mc, int64_t seed, int x1, int z1, int x2, int z2, int r1, int r2)
+// Strongholds are generated in rings around the origin. The strongholds of a
+// ring are evenly spaced in angle, at a random distance within the band of the
+// ring, and the biome search then moves each of them by at most 112 blocks.
+//
+// -MC_1_8: one ring of 3, r = 640 + [0,1]*512
+// MC_1_9+: 8 rings of 128 in total, r = 1408 + 3072*n + 1280*[0,1]
+
+static int strongholdRings(int mc)
+{
+    return mc < MC_1_9 ? 1 : 8;
+}
+
+static int strongholdRingSize(int mc, int ring)
+{
+    static const int size[] = { 3, 6, 10, 15, 21, 28, 36, 9 };
+    return mc < MC_1_9 ? 3 : size[ring];
+}
+
+// index of the first stronghold of a ring
+static int strongholdRingStart(int mc, int ring)
+{
+    int i = 0;
+    for (int r = 0; r < ring; r++)
+        i += strongholdRingSize(mc, r);
+    return i;
+}
+
+static int strongholdRingOf(int mc, int idx)
+{
+    int r = 0;
+    while (r+1 < strongholdRings(mc) && idx >= strongholdRingStart(mc, r+1))
+        r++;
+    return r;
+}
+
+static void strongholdRingRadius(int mc, int ring, double *r1, double *r2)
+{
+    if (mc < MC_1_9)
+    {
+        *r1 = 640;
+        *r2 = 1152;
+    }
+    else
+    {
+        *r1 = 1408 + 3072*ring;
+        *r2 = *r1 + 1280;
+    }
+}
+
+// number of the inner ring generation angles in [k0,k1) whose strongholds can
+// lie in the area
+static int innerRingHits(int mc, int64_t seed, int x1, int z1, int x2, int z2, double r1, double r2, int k0, int k1)
 {
     StrongholdIter sh;
     Pos p = initFirstStronghold(&sh, mc, seed);
+    int hits = 0;
+
+    for (int k = k0; k < k1; k++)
+    {
+        if (k == 0)
+        {   // the approximate position of the first stronghold is known
+            if (p.x >= x1-112 && p.x <= x2+112 && p.z >= z1-112 && p.z <= z2+112)
+                hits++;
+            continue;
+        }
+        // Do a ray cast analysis, checking if the generation angle intersects the area.
+        double c = cos(sh.angle + M_PI*2/3 * k);
+        double s = sin(sh.angle + M_PI*2/3 * k);
+        if (intersectRectLine(x1-112, z1-112, x2+112, z2+112, c*r1, s*r1, c*r2, s*r2))
+            hits++;
+    }
+    return hits;
+}
+
+// angle under which the rectangle appears from the origin
+static double angularSpan(double x1, double z1, double x2, double z2)
+{
+    if (x1 <= 0 && x2 >= 0 && z1 <= 0 && z2 >= 0)
+        return 2*M_PI;
+    const double cx[] = { x1, x2, x1, x2 };
+    const double cz[] = { z1, z1, z2, z2 };
+    double ac = atan2((z1+z2) / 2, (x1+x2) / 2);
+    double lo = 0, hi = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        double d = atan2(cz[i], cx[i]) - ac;
+        if (d > M_PI) d -= 2*M_PI;
+        if (d < -M_PI) d += 2*M_PI;
+        lo = d < lo ? d : lo;
+        hi = d > hi ? d : hi;
+    }
+    return hi - lo;
+}
+
+// Can 'count' strongholds with indices in [i0,i1) lie in the area? All of them
+// have to belong to the same ring. The angles of the outer rings depend on the
+// biome search, but their spacing does not.
+static bool isRingOk(int mc, int64_t seed, int x1, int z1, int x2, int z2, int i0, int i1, int count)
+{
+    int ring = strongholdRingOf(mc, i0);
+    int n = strongholdRingSize(mc, ring);
+    double r1, r2;
+    strongholdRingRadius(mc, ring, &r1, &r2);
 
-    if (p.x >= x1 && p.x <= x2 && p.z >= z1 && p.z <= z2)
+    if (ring == 0)
+        return innerRingHits(mc, seed, x1, z1, x2, z2, r1, r2, i0, i1) >= count;
+    if (count <= 1)
         return true;
-    // Do a ray cast analysis, checking if any of the generation angles intersect the area.
-    double c, s;
-    c = cos(sh.angle + M_PI*2/3);
-    s = sin(sh.angle + M_PI*2/3);
-    if (intersectRectLine(x1-112, z1-112, x2+112, z2+112, c*r1, s*r1, c*r2, s*r2))
+    double span = angularSpan(x1-112, z1-112, x2+112, z2+112);
+    return span + 1e-9 >= (count - 1) * 2*M_PI / n;
+}
+
+// The slime chunk test is a single step of the Java LCG on the lower 48 bits
+// of the seed plus a chunk dependent offset, which is vectorized over the
+// chunks of a row with AVX2 on x86 (four chunks per vector). Lanes that need
+// the (very rare) rejection step of nextInt() are retested with the scalar
+// isSlimeChunk().
+
+static inline int64_t slimeOffsetX(int cx)
+{
+    return (int64_t)(int)((uint32_t)cx * 0x5ac0db) + (int)((uint32_t)cx * (uint32_t)cx * 0x4c1906);
+}
+
+static inline int64_t slimeOffsetZ(int cz)
+{
+    return (int64_t)(int)((uint32_t)cz * 0x5f24f) + (int64_t)(int)((uint32_t)cz * (uint32_t)cz) * 0x4307a7LL;
+}
+
+static int countSlimeScalar(int64_t seed, int rx1, int rz1, int rx2, int rz2, int count)
+{
+    int qual = 0;
+    for (int rz = rz1; rz <= rz2; rz++)
+    {
+        for (int rx = rx1; rx <= rx2; rx++)
+        {
+            if (isSlimeChunk(seed, rx, rz))
+                if (++qual >= count)
+                    return qual;
+        }
+    }
+    return qual;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static int countSlimeAVX2(int64_t seed, int rx1, int rz1, int rx2, int rz2, int count)
+{
+    enum { COLS = 256 };
+    alignas(32) int64_t offx[COLS];
+    const __m256i mask48 = _mm256_set1_epi64x((1LL << 48) - 1);
+    const __m256i xorkey = _mm256_set1_epi64x(0x3ad8025fLL ^ 0x5deece66dLL);
+    const __m256i mullo = _mm256_set1_epi64x(0xdeece66dLL);
+    const __m256i mulhi = _mm256_set1_epi64x(0x5);
+    const __m256i addend = _mm256_set1_epi64x(0xb);
+    const __m256i inv5 = _mm256_set1_epi64x(0xcccccccdLL);    // 5^-1 mod 2^32
+    const __m256i lo32 = _mm256_set1_epi64x(0xffffffffLL);
+    const __m256i div10max = _mm256_set1_epi64x(0x19999999LL);
+    const __m256i rejmin = _mm256_set1_epi64x(0x7ffffff0LL);
+    int qual = 0;
+
+    for (int cx0 = rx1; cx0 <= rx2; cx0 += COLS)
+    {
+        int n = rx2 - cx0 + 1 < COLS ? rx2 - cx0 + 1 : COLS;
+        for (int i = 0; i < n; i++)
+            offx[i] = slimeOffsetX(cx0 + i);
+
+        for (int rz = rz1; rz <= rz2; rz++)
+        {
+            int64_t sz = seed + slimeOffsetZ(rz);
+            __m256i vz = _mm256_set1_epi64x(sz);
+            int i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                __m256i r = _mm256_add_epi64(vz, _mm256_load_si256((const __m256i*)(offx + i)));
+                r = _mm256_and_si256(_mm256_xor_si256(r, xorkey), mask48);
+                // r * 0x5deece66d mod 2^48 from 32-bit partial products
+                __m256i p0 = _mm256_mul_epu32(r, mullo);
+                __m256i p1 = _mm256_add_epi64(
+                        _mm256_mul_epu32(_mm256_srli_epi64(r, 32), mullo),
+                        _mm256_mul_epu32(r, mulhi));
+                r = _mm256_add_epi64(_mm256_add_epi64(p0, _mm256_slli_epi64(p1, 32)), addend);
+                __m256i bits = _mm256_srli_epi64(_mm256_and_si256(r, mask48), 17);
+                // bits % 10 == 0  <=>  ror32(bits * 5^-1, 1) <= (2^32-1) / 10
+                __m256i q = _mm256_and_si256(_mm256_mul_epu32(bits, inv5), lo32);
+                q = _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(q, 1), _mm256_slli_epi64(q, 31)), lo32);
+                __m256i noslime = _mm256_cmpgt_epi64(q, div10max);
+                int m = ~_mm256_movemask_pd(_mm256_castsi256_pd(noslime)) & 0xf;
+                if (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(bits, rejmin))))
+                {
+                    m = 0;
+                    for (int j = 0; j < 4; j++)
+                        m |= isSlimeChunk(seed, cx0 + i + j, rz) << j;
+                }
+                if (m && (qual += __builtin_popcount(m)) >= count)
+                    return qual;
+            }
+            for (; i < n; i++)
+            {
+                if (isSlimeChunk(seed, cx0 + i, rz))
+                    if (++qual >= count)
+                        return qual;
+            }
+        }
+    }
+    return qual;
+}
+
+// number of slime chunks in the area, counting up to 'count'
+static int countSlime(int64_t seed, int rx1, int rz1, int rx2, int rz2, int count)
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2 && rx2 - rx1 >= 3)
+        return countSlimeAVX2(seed, rx1, rz1, rx2, rz2, count);
+    return countSlimeScalar(seed, rx1, rz1, rx2, rz2, count);
+}
+#else
+// number of slime chunks in the area, counting up to 'count'
+static int countSlime(int64_t seed, int rx1, int rz1, int rx2, int rz2, int count)
+{
+    return countSlimeScalar(seed, rx1, rz1, rx2, rz2, count);
+}
+#endif
+
+
+SearchContext::~SearchContext()
+{
+    for (LayerStack *g : gen)
+        delete g;
+    free(area);
+}
+
+LayerStack *SearchContext::getGenerator(int mc)
+{
+    if (mc >= (int) gen.size())
+        gen.resize(mc + 1);
+    if (!gen[mc])
+    {
+        gen[mc] = new LayerStack;
+        setupGenerator(gen[mc], mc);
+    }
+    return gen[mc];
+}
+
+int *SearchContext::getArea(const Layer *layer, int w, int h)
+{
+    size_t n = getMinCacheSize(layer, w, h);
+    if (n > areasiz)
+    {
+        free(area);
+        area = (int*) malloc(n * sizeof(int));
+        areasiz = n;
+    }
+    return area;
+}
+
+const char *SearchContext::getSpawnPotential(int mc)
+{
+    if ((int) spawnpot.size() <= mc)
+        spawnpot.resize(mc + 1);
+    std::vector<char>& pot = spawnpot[mc];
+    if (pot.empty())
+    {
+        pot.resize(256);
+        const uint64_t spawnbiomes =
+            (1ULL << forest) | (1ULL << plains) | (1ULL << taiga) | (1ULL << taiga_hills) |
+            (1ULL << wooded_hills) | (1ULL << jungle) | (1ULL << jungle_hills);
+        for (int id = 0; id < 256; id++)
+        {
+            uint64_t mL = 0, mM = 0;
+            genPotential(&mL, &mM, L_SUNFLOWER_64, mc, id);
+            pot[id] = (mL & spawnbiomes) != 0;
+        }
+    }
+    return pot.data();
+}
+
+const char *SearchContext::getViablePotential(int stype, int mc)
+{
+    enum { N = End_City + 1, STRIDE = 257 };
+    if (stype < 0 || stype >= N)
+        return NULL;
+    if ((int) viablepot.size() <= mc)
+        viablepot.resize(mc + 1);
+    if (viablepot[mc].empty())
+        viablepot[mc].assign(N * STRIDE, 0);
+    char *pot = &viablepot[mc][stype * STRIDE];
+    if (pot[0] == 0)
+    {
+        uint64_t vL = 0, vM = 0;
+        for (int id = 0; id < 64; id++)
+        {
+            if (isViableFeatureBiome(stype, id)) vL |= (1ULL << id);
+            if (isViableFeatureBiome(stype, id+128)) vM |= (1ULL << id);
+        }
+        bool any = true;
+        for (int id = 0; id < 256; id++)
+        {
+            uint64_t mL = 0, mM = 0;
+            genPotential(&mL, &mM, L_SUNFLOWER_64, mc, id);
+            pot[1+id] = (mL & vL) || (mM & vM);
+            any &= pot[1+id];
+        }
+        pot[0] = any ? 1 : 2;
+    }
+    return pot[0] == 2 ? pot + 1 : NULL;
+}
+
+LayerStack *SeedContext::getSeeded(int64_t seed, LayerStack *g)
+{
+    use(seed, g);
+    if (!seeded)
+    {
+        applySeed(g, seed);
+        seeded = true;
+    }
+    return g;
+}
+
+Pos SeedContext::getSpawn(int mc, int64_t seed, LayerStack *g)
+{
+    use(seed, g);
+    if (!hasspawn)
+    {
+        spawn = ::getSpawn(mc, getSeeded(seed, g), NULL, seed);
+        hasspawn = true;
+    }
+    return spawn;
+}
+
+const StrongholdIter *SeedContext::getStronghold(int mc, int64_t seed, LayerStack *g, int i)
+{
+    use(seed, g);
+    if (shcnt < 0)
+    {
+        initFirstStronghold(&sh, mc, seed);
+        shcnt = 0;
+    }
+    while (shcnt <= i && !shend)
+    {
+        if (nextStronghold(&sh, getSeeded(seed, g), NULL) > 0 && shcnt < MAX_STRONGHOLDS)
+            shlist[shcnt++] = sh;
+        else
+            shend = true;
+    }
+    return i < shcnt ? &shlist[i] : NULL;
+}
+
+int SeedContext::getBiome64(int64_t seed, LayerStack *g, int cx, int cz)
+{
+    use(seed, g);
+    if (tiles64.empty())
+        tiles64.resize(TILES64);
+    int tx = cx >> 4, tz = cz >> 4; // tiles of TILE64 = 16 cells
+    Tile64& t = tiles64[((uint32_t)tx * 0x9e3779b1u ^ (uint32_t)tz) % TILES64];
+    if (t.epoch != epoch || t.tx != tx || t.tz != tz)
+    {
+        SearchContext& ctx = getSearchContext();
+        const Layer *layer = &getSeeded(seed, g)->layers[L_SUNFLOWER_64];
+        int *area = ctx.getArea(layer, TILE64, TILE64);
+        genArea(layer, area, tx * TILE64, tz * TILE64, TILE64, TILE64);
+        memcpy(t.ids, area, sizeof(t.ids));
+        t.epoch = epoch;
+        t.tx = tx;
+        t.tz = tz;
+    }
+    return t.ids[(cz - tz * TILE64) * TILE64 + (cx - tx * TILE64)];
+}
+
+const int *SeedContext::getBiomeGroup(const BiomePlan *plan, int gi, int64_t seed, LayerStack *g)
+{
+    use(seed, g);
+    if ((int) areas.size() <= gi)
+        areas.resize(gi + 1);
+    GroupArea& a = areas[gi];
+    if (a.epoch != epoch)
+    {
+        const BiomeGroup& bg = plan->groups[gi];
+        const Layer *layer = &getSeeded(seed, g)->layers[bg.layer];
+        a.buf.resize(getMinCacheSize(layer, bg.w, bg.h));
+        genArea(layer, a.buf.data(), bg.x, bg.z, bg.w, bg.h);
+        a.epoch = epoch;
+    }
+    return a.buf.data();
+}
+
+void setupBiomePlan(BiomePlan *plan, const Condition *cond, int ccnt, const int *cmc)
+{
+    plan->groups.clear();
+    for (int i = 0; i < 100; i++)
+        plan->group[i] = -1;
+
+    std::vector<char> used(ccnt);
+    for (int i = 0; i < ccnt; i++)
+    {
+        const Condition& ci = cond[i];
+        if (used[i] || ci.relative || ci.type < F_BIOME || ci.type > F_BIOME_256_OTEMP)
+            continue;
+        int layer = g_filterinfo.list[ci.type].layer;
+        int x1 = ci.x1, z1 = ci.z1, x2 = ci.x2, z2 = ci.z2;
+        int64_t sum = (int64_t)(x2-x1+1) * (z2-z1+1);
+        std::vector<int> members = { i };
+
+        for (int j = i+1; j < ccnt; j++)
+        {
+            const Condition& cj = cond[j];
+            if (used[j] || cj.relative || cj.type < F_BIOME || cj.type > F_BIOME_256_OTEMP)
+                continue;
+            if (g_filterinfo.list[cj.type].layer != layer)
+                continue;
+            if (cmc && cmc[j] != cmc[i])
+                continue;
+            int ux1 = std::min(x1, cj.x1), uz1 = std::min(z1, cj.z1);
+            int ux2 = std::max(x2, cj.x2), uz2 = std::max(z2, cj.z2);
+            int64_t usum = sum + (int64_t)(cj.x2-cj.x1+1) * (cj.z2-cj.z1+1);
+            if ((int64_t)(ux2-ux1+1) * (uz2-uz1+1) > usum)
+                continue; // more cells than separately
+            x1 = ux1; z1 = uz1; x2 = ux2; z2 = uz2;
+            sum = usum;
+            members.push_back(j);
+        }
+        if (members.size() < 2)
+            continue;
+
+        BiomeGroup bg = { layer, x1, z1, x2-x1+1, z2-z1+1 };
+        for (int k : members)
+        {
+            used[k] = 1;
+            plan->group[cond[k].save] = plan->groups.size();
+        }
+        plan->groups.push_back(bg);
+    }
+}
+
+SearchContext& getSearchContext()
+{
+    thread_local SearchContext ctx;
+    return ctx;
+}
+
+
+// block area and region range of a structure condition
+static void getStructArea(const StructPos *spos, const Condition *cond, const StructureConfig& sconf,
+        int *x1, int *z1, int *x2, int *z2, int *rx1, int *rz1, int *rx2, int *rz2)
+{
+    *x1 = cond->x1;
+    *z1 = cond->z1;
+    *x2 = cond->x2;
+    *z2 = cond->z2;
+    if (cond->relative)
+    {
+        *x1 += spos[cond->relative].cx;
+        *z1 += spos[cond->relative].cz;
+        *x2 += spos[cond->relative].cx;
+        *z2 += spos[cond->relative].cz;
+    }
+
+    if (sconf.regionSize == 32)
+    {
+        *rx1 = *x1 >> 9;
+        *rz1 = *z1 >> 9;
+        *rx2 = *x2 >> 9;
+        *rz2 = *z2 >> 9;
+    }
+    else if (sconf.regionSize == 1)
+    {
+        *rx1 = *x1 >> 4;
+        *rz1 = *z1 >> 4;
+        *rx2 = *x2 >> 4;
+        *rz2 = *z2 >> 4;
+    }
+    else
+    {
+        *rx1 = (*x1 / (sconf.regionSize << 4)) - (*x1 < 0);
+        *rz1 = (*z1 / (sconf.regionSize << 4)) - (*z1 < 0);
+        *rx2 = (*x2 / (sconf.regionSize << 4)) - (*x2 < 0);
+        *rz2 = (*z2 / (sconf.regionSize << 4)) - (*z2 < 0);
+    }
+}
+
+bool isStructCond(const Condition *cond)
+{
+    return cond->type >= F_DESERT && cond->type <= F_PORTAL;
+}
+
+bool isCond48(const Condition *cond, int ccnt, int i)
+{
+    if (g_filterinfo.list[cond[i].type].cat != CAT_48)
+        return false;
+    if (cond[i].type != F_SLIME)
         return true;
-    c = cos(sh.angle + M_PI*4/3);
-    s = sin(sh.angle + M_PI*4/3);
-    if (intersectRectLine(x1-112, z1-112, x2+112, z2+112, c*r1, s*r1, c*r2, s*r2))
+    // the references come first, so the chain ends
+    for (int ref = cond[i].relative; ref; )
+    {
+        int j = i - 1;
+        while (j >= 0 && cond[j].save != ref)
+            j--;
+        if (j < 0 || g_filterinfo.list[cond[j].type].cat != CAT_48)
+            return false;
+        ref = cond[j].relative;
+        i = j;
+    }
+    return true;
+}
+
+void getCondPositions(const StructPos *spos, int64_t seed, const Condition *cond, int mc, std::vector<Pos> *pos)
+{
+    int x1, x2, z1, z2;
+    int rx1, rx2, rz1, rz2, rx, rz;
+    StructureConfig sconf;
+    Pos pc;
+
+    pos->clear();
+    if (!getConfig(g_filterinfo.list[cond->type].stype, mc, &sconf))
+        return;
+    getStructArea(spos, cond, sconf, &x1, &z1, &x2, &z2, &rx1, &rz1, &rx2, &rz2);
+
+    for (rz = rz1; rz <= rz2; rz++)
+    {
+        for (rx = rx1; rx <= rx2; rx++)
+        {
+            if (!getStructurePos(sconf.structType, mc, seed, rx+0, rz+0, &pc))
+                continue;
+            if (pc.x >= x1 && pc.x <= x2 && pc.z >= z1 && pc.z <= z2)
+                pos->push_back(pc);
+        }
+    }
+}
+
+// The biomes at 1:64 (L_SUNFLOWER_64) are at most FUZZ_64 blocks away from
+// the 1:4 biomes they become, through the zoom, island and smoothing layers.
+enum { FUZZ_64 = 192 };
+
+// Tiered viability test of a structure position: every structure needs an
+// accepted biome at its position, so the cached 1:64 biomes around it can
+// rule it out before the biomes at its native scale are generated.
+static bool isViablePos(int stype, int mc, int64_t seed, LayerStack *g, int x, int z)
+{
+    const char *pot = mc >= MC_1_7 ? getSearchContext().getViablePotential(stype, mc) : NULL;
+    if (pot)
+    {
+        SeedContext& sc = getSearchContext().seedctx;
+        int cx1 = (x - FUZZ_64) >> 6, cx2 = (x + FUZZ_64) >> 6;
+        int cz1 = (z - FUZZ_64) >> 6, cz2 = (z + FUZZ_64) >> 6;
+        bool ok = false;
+        for (int cz = cz1; cz <= cz2 && !ok; cz++)
+        {
+            for (int cx = cx1; cx <= cx2 && !ok; cx++)
+            {
+                int id = sc.getBiome64(seed, g, cx, cz);
+                ok = id < 0 || id >= 256 || pot[id];
+            }
+        }
+        if (!ok)
+            return false;
+    }
+    return isViableStructurePos(stype, mc, g, seed, x, z);
+}
+
+int testCondPositions(StructPos *spos, int64_t seed, const Condition *cond, int mc, LayerStack *g,
+        const Pos *pos, int n, std::atomic_bool *abort)
+{
+    StructureConfig sconf;
+    StructPos *sout = spos + cond->save;
+    int xt = 0, zt = 0, qual = 0;
+
+    if (!getConfig(g_filterinfo.list[cond->type].stype, mc, &sconf))
+        return 0;
+
+    sout->cx = 0;
+    sout->cz = 0;
+    for (int i = 0; i < n && !*abort; i++)
+    {
+        if (g && !isViablePos(sconf.structType, mc, seed, g, pos[i].x, pos[i].z))
+            continue;
+
+        xt += pos[i].x;
+        zt += pos[i].z;
+
+        if (++qual >= cond->count)
+        {
+            sout->sconf = sconf;
+            sout->cx = xt / qual;
+            sout->cz = zt / qual;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Partial-bit solve of the structure placement. The offsets of a structure in
+// its region are (s1 >> 17) % chunkRange and (s2 >> 17) % chunkRange for the
+// first two states of the Java LCG, seeded with the 48-bit seed plus a region
+// constant. With chunkRange = m*2^k, the offsets modulo 2^k only depend on the
+// lower 17+k bits of the seed, and so does whether an area can be reached.
+//
+// When s1 or s2 falls into the rejection band of nextInt(), an offset is
+// taken from a later state instead, which the residues do not model. The band
+// is only the top (2^31 % chunkRange) values of (state >> 17), so the seeds
+// with a state in it are enumerated for each region, and those that reach the
+// area with a residue outside the mask are listed as extra candidates. A
+// matching seed outside the mask of a condition has to be one of these, as
+// the model can only miss a region through a rejection.
+
+enum { LOW48_MAXBITS = 20, LOW48_MAXREG = 16, LOW48_MAXBAND = 1 << 25 };
+
+static const uint64_t JAVA_MUL = 0x5deece66dULL, JAVA_ADD = 0xb;
+
+// a seed for which the first (or second) state of the region has the given value
+static int64_t seedForState(int64_t regconst, uint64_t state, bool second)
+{
+    const uint64_t inv = 0xdfe05bcb1365ULL; // JAVA_MUL^-1 mod 2^48
+    uint64_t s = state;
+    if (second)
+        s = ((s - JAVA_ADD) * inv) & MASK48;
+    uint64_t u = ((s - JAVA_ADD) * inv) & MASK48;
+    return (int64_t)(((u ^ JAVA_MUL) - (uint64_t)regconst) & MASK48);
+}
+
+// Residue mask over the lower 17+k bits for one structure condition, or false
+// if the condition does not allow a restriction. The seeds that can match with
+// a residue outside the mask are added to 'extra'.
+static bool getLow48Mask(const Condition *cond, int mc, int *bits, std::vector<char> *mask,
+                         std::vector<int64_t> *extra)
+{
+    StructureConfig sconf;
+    int stype = g_filterinfo.list[cond->type].stype;
+    switch (stype)
+    {
+    case Desert_Pyramid: case Jungle_Pyramid: case Swamp_Hut: case Igloo:
+    case Village: case Outpost: case Ocean_Ruin: case Shipwreck: case Ruined_Portal:
+        break;
+    default:
+        return false; // triangular or per chunk placement
+    }
+    if (cond->relative || cond->count < 1 || !getConfig(stype, mc, &sconf))
+        return false;
+    int range = sconf.chunkRange;
+    int k = 0;
+    while (k < LOW48_MAXBITS - 17 && range > 0 && ((range >> k) & 1) == 0)
+        k++;
+    if (k == 0 || (range & (range - 1)) == 0)
+        return false;
+
+    int x1, z1, x2, z2, rx1, rz1, rx2, rz2;
+    StructPos zero[100] = {};
+    getStructArea(zero, cond, sconf, &x1, &z1, &x2, &z2, &rx1, &rz1, &rx2, &rz2);
+    int nreg = (rx2 - rx1 + 1) * (rz2 - rz1 + 1);
+    if (nreg <= 0 || nreg > LOW48_MAXREG)
+        return false;
+    // the rejection band of nextInt(range) for (state >> 17)
+    uint64_t band = ((uint64_t)1 << 31) % range;
+    if ((band << 17) * 2 * nreg > LOW48_MAXBAND)
+        return false;
+
+    // calibrate the offsets of each region against getStructurePos(), and
+    // note which residues can reach the area
+    struct Region { int64_t regconst; uint32_t ax, az; std::vector<int> px, pz; };
+    std::vector<Region> regs;
+    uint64_t rnd = 0x9e3779b97f4a7c15ULL;
+    for (int rz = rz1; rz <= rz2; rz++)
+    {
+        for (int rx = rx1; rx <= rx2; rx++)
+        {
+            Region r;
+            r.regconst = rx * 341873128712LL + rz * 132897987541LL + sconf.salt;
+            r.ax = r.az = 0;
+            r.px.resize(range);
+            r.pz.resize(range);
+            for (int o = 0; o < range; o++)
+            {
+                Pos p;
+                getStructurePos(stype, mc, seedForState(r.regconst, (uint64_t)o << 17, false), rx, rz, &p);
+                r.px[o] = p.x;
+                if (p.x >= x1 && p.x <= x2)
+                    r.ax |= 1U << (o & ((1 << k) - 1));
+                getStructurePos(stype, mc, seedForState(r.regconst, (uint64_t)o << 17, true), rx, rz, &p);
+                r.pz[o] = p.z;
+                if (p.z >= z1 && p.z <= z2)
+                    r.az |= 1U << (o & ((1 << k) - 1));
+            }
+            // verify the placement model on random seeds
+            for (int i = 0; i < 64; i++)
+            {
+                rnd = rnd * 6364136223846793005ULL + 1442695040888963407ULL;
+                int64_t s = (int64_t)(rnd >> 16);
+                uint64_t s1 = (((s + r.regconst) ^ JAVA_MUL) * JAVA_MUL + JAVA_ADD) & MASK48;
+                uint64_t s2 = (s1 * JAVA_MUL + JAVA_ADD) & MASK48;
+                Pos p;
+                getStructurePos(stype, mc, s, rx, rz, &p);
+                if (p.x != r.px[(int)(s1 >> 17) % range] || p.z != r.pz[(int)(s2 >> 17) % range])
+                    return false;
+            }
+            regs.push_back(r);
+        }
+    }
+
+    *bits = 17 + k;
+    uint64_t m = (1ULL << *bits) - 1;
+    uint64_t km = (1ULL << k) - 1;
+    mask->assign(m + 1, 0);
+    for (uint64_t w = 0; w <= m; w++)
+    {
+        int n = 0;
+        for (const Region& r : regs)
+        {
+            uint64_t s1 = (((w + r.regconst) ^ JAVA_MUL) * JAVA_MUL + JAVA_ADD) & m;
+            uint64_t s2 = (s1 * JAVA_MUL + JAVA_ADD) & m;
+            n += (r.ax >> ((s1 >> 17) & km)) & (r.az >> ((s2 >> 17) & km)) & 1;
+        }
+        (*mask)[w] = n >= cond->count;
+    }
+
+    // the seeds with s1 or s2 in the rejection band, where the placement is
+    // taken as it is
+    for (int rz = rz1; rz <= rz2; rz++)
+    {
+        for (int rx = rx1; rx <= rx2; rx++)
+        {
+            int64_t regconst = rx * 341873128712LL + rz * 132897987541LL + sconf.salt;
+            for (int second = 0; second < 2; second++)
+            {
+                uint64_t first = (((uint64_t)1 << 31) - band) << 17;
+                for (uint64_t st = first; st < ((uint64_t)1 << 48); st++)
+                {
+                    int64_t s = seedForState(regconst, st, second);
+                    if ((*mask)[s & m])
+                        continue;
+                    Pos p;
+                    if (getStructurePos(stype, mc, s, rx, rz, &p) &&
+                        p.x >= x1 && p.x <= x2 && p.z >= z1 && p.z <= z2)
+                        extra->push_back(s);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool getLow48Residues(const Condition *cond, int ccnt, int mc, int *bits, std::vector<uint32_t> *res,
+                      std::vector<int64_t> *extra)
+{
+    std::vector<char> all, mask;
+    int allbits = 0;
+    extra->clear();
+    for (int i = 0; i < ccnt; i++)
+    {
+        int b;
+        if (!getLow48Mask(cond + i, mc, &b, &mask, extra))
+            continue;
+        if (all.empty())
+        {
+            all.swap(mask);
+            allbits = b;
+            continue;
+        }
+        // combine at the larger number of bits
+        if (b > allbits)
+        {
+            all.swap(mask);
+            std::swap(b, allbits);
+        }
+        for (size_t w = 0; w < all.size(); w++)
+            all[w] &= mask[w & ((1ULL << b) - 1)];
+    }
+
+    res->clear();
+    for (size_t w = 0; w < all.size(); w++)
+        if (all[w])
+            res->push_back(w);
+    *bits = allbits;
+    // a seed outside the residues of one condition is outside all of them
+    std::sort(extra->begin(), extra->end());
+    extra->erase(std::unique(extra->begin(), extra->end()), extra->end());
+    // only worth it if a good part of the residues can be skipped
+    return !all.empty() && res->size() * 10 < all.size() * 9;
+}
+
+// tests the structures of a condition within the given block area and regions
+static int testStructArea(const Condition *cond, const StructureConfig& sconf, int mc, int64_t seed,
+        LayerStack *g, StructPos *sout, int x1, int z1, int x2, int z2,
+        int rx1, int rz1, int rx2, int rz2, std::atomic_bool *abort)
+{
+    int xt, zt, qual, rx, rz;
+    Pos pc;
+
+    // TODO: warn if multistructure clusters are used as a positional
+    // dependency (the centre can change based on biomes)
+
+    sout->cx = xt = 0;
+    sout->cz = zt = 0;
+    qual = 0;
+
+    // Note "<="
+    for (rz = rz1; rz <= rz2 && !*abort; rz++)
+    {
+        for (rx = rx1; rx <= rx2; rx++)
+        {
+            if (!getStructurePos(sconf.structType, mc, seed, rx+0, rz+0, &pc))
+                continue;
+            if (pc.x >= x1 && pc.x <= x2 && pc.z >= z1 && pc.z <= z2)
+            {
+                if (g && !isViablePos(sconf.structType, mc, seed, g, pc.x, pc.z))
+                    continue;
+
+                xt += pc.x;
+                zt += pc.z;
+
+                if (++qual >= cond->count)
+                {
+                    sout->sconf = sconf;
+                    sout->cx = xt / qual;
+                    sout->cz = zt / qual;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// tests a biome condition on the given area of its layer
+static int testBiomeArea(const Condition *cond, int layer, int mc, int64_t seed, LayerStack *g,
+        int rx1, int rz1, int rx2, int rz2, std::atomic_bool *abort)
+{
+    int valid;
+    if (!g)
+    {
+        if (layer != L_OCEAN_TEMP_256)
+            return 1;
+        if (mc < MC_1_13)
+            return 0;
+        g = getSearchContext().getGenerator(MC_1_13);
+    }
+    valid = 0;
+    if (const BiomePlan *plan = getSearchContext().biomeplan)
+    {
+        int gi = plan->group[cond->save];
+        if (gi >= 0 && !*abort)
+        {   // evaluate the area within the shared group area
+            const BiomeGroup& bg = plan->groups[gi];
+            const int *area = getSearchContext().seedctx.getBiomeGroup(plan, gi, seed, g);
+            uint64_t b = 0, bm = 0;
+            for (int j = rz1; j <= rz2; j++)
+            {
+                const int *row = area + (j - bg.z) * bg.w - bg.x;
+                for (int i = rx1; i <= rx2; i++)
+                {
+                    int id = row[i];
+                    if (id < 128) b |= (1ULL << id);
+                    else bm |= (1ULL << (id-128));
+                }
+            }
+            uint64_t inclb = cond->bfilter.riverToFind | cond->bfilter.oceanToFind;
+            uint64_t inclm = cond->bfilter.riverToFindM;
+            if ((b & inclb) == inclb && (bm & inclm) == inclm &&
+                (b & cond->exclb) == 0 && (bm & cond->exclm) == 0)
+                valid = 1;
+            return valid;
+        }
+    }
+    if (rx2 >= rx1 || rz2 >= rz1 || !*abort)
+    {
+        int w = rx2-rx1+1;
+        int h = rz2-rz1+1;
+        int *area = getSearchContext().getArea(&g->layers[layer], w, h);
+        if (checkForBiomes(g, layer, area, seed, rx1, rz1, w, h, cond->bfilter, 0) > 0)
+        {
+            // check biome exclusion
+            uint64_t b = 0, bm = 0;
+            for (int i = 0; i < w*h; i++)
+            {
+                int id = area[i];
+                if (id < 128) b |= (1ULL << id);
+                else bm |= (1ULL << (id-128));
+            }
+            if ((b & cond->exclb) == 0 && (bm & cond->exclm) == 0)
+                valid = 1;
+        }
+    }
+    return valid;
+}
+
+// Since 1.13 the spawn is bounded: getSpawn() picks a spawn biome within 256
+// blocks of the origin at 1:4 (or falls back to (8,8) without one), and then
+// looks for grass in a spiral of up to 16 chunks around it. With the 1:64
+// biomes this can prove that a spawn cannot lie in the area before the full
+// search is run.
+enum { SPAWN_RANGE = 256, SPAWN_SPIRAL = 272 };
+
+// Returns false if the spawn can be ruled out for the area. Without a
+// generator, only the seed independent bound is checked.
+static bool isSpawnPossible(int mc, int64_t seed, LayerStack *g, int x1, int z1, int x2, int z2)
+{
+    if (mc < MC_1_13)
+        return true; // older versions move the spawn in a random walk
+
+    // range of biome positions from which the spiral could reach the area
+    int bx1 = std::max(x1 - SPAWN_SPIRAL, -SPAWN_RANGE);
+    int bz1 = std::max(z1 - SPAWN_SPIRAL, -SPAWN_RANGE);
+    int bx2 = std::min(x2 + SPAWN_SPIRAL, SPAWN_RANGE + 3);
+    int bz2 = std::min(z2 + SPAWN_SPIRAL, SPAWN_RANGE + 3);
+    if (bx1 > bx2 || bz1 > bz2)
+        return false;
+    if (!g || (bx1 <= 8 && bx2 >= 8 && bz1 <= 8 && bz2 >= 8))
         return true;
 
+    // look for biomes at 1:64 that can turn into a spawn biome in that range
+    SearchContext& ctx = getSearchContext();
+    const char *pot = ctx.getSpawnPotential(mc);
+    int cx1 = (bx1 - FUZZ_64) >> 6, cx2 = (bx2 + FUZZ_64) >> 6;
+    int cz1 = (bz1 - FUZZ_64) >> 6, cz2 = (bz2 + FUZZ_64) >> 6;
+    int w = cx2 - cx1 + 1, h = cz2 - cz1 + 1;
+    const Layer *layer = &ctx.seedctx.getSeeded(seed, g)->layers[L_SUNFLOWER_64];
+    int *area = ctx.getArea(layer, w, h);
+    genArea(layer, area, cx1, cz1, w, h);
+    for (int i = 0; i < w*h; i++)
+    {
+        if (area[i] >= 0 && area[i] < 256 && pot[area[i]])
+            return true;
+    }
     return false;
 }
 
+// tests the strongholds of a condition, in the selection of its mode, within
+// the given block area
+static int testStronghold(const Condition *cond, int mc, int64_t seed, LayerStack *g, StructPos *sout,
+        int x1, int z1, int x2, int z2, std::atomic_bool *abort)
+{
+    int nrings = strongholdRings(mc);
+    int total = strongholdRingStart(mc, nrings);
+    int i0, i1;
+
+    switch (cond->temps[SH_MODE])
+    {
+    case SH_FIRST:
+        i0 = 0;
+        i1 = std::min(std::max(cond->temps[SH_ARG], 1), total);
+        break;
+    case SH_RING:
+        if (cond->temps[SH_ARG] < 0 || cond->temps[SH_ARG] >= nrings)
+            return 0;
+        i0 = strongholdRingStart(mc, cond->temps[SH_ARG]);
+        i1 = strongholdRingStart(mc, cond->temps[SH_ARG] + 1);
+        break;
+    default:
+        i0 = 0;
+        i1 = total;
+    }
+
+    // restrict the selection to the rings whose distance band reaches the area
+    double ax1 = x1 - 112, az1 = z1 - 112, ax2 = x2 + 112, az2 = z2 + 112;
+    double nx = ax1 > 0 ? ax1 : ax2 < 0 ? -ax2 : 0;
+    double nz = az1 > 0 ? az1 : az2 < 0 ? -az2 : 0;
+    double fx = std::max(fabs(ax1), fabs(ax2));
+    double fz = std::max(fabs(az1), fabs(az2));
+    double dmin = sqrt(nx*nx + nz*nz);
+    double dmax = sqrt(fx*fx + fz*fz);
+    int lo = nrings, hi = -1;
+    for (int ring = 0; ring < nrings; ring++)
+    {
+        double r1, r2;
+        strongholdRingRadius(mc, ring, &r1, &r2);
+        if (dmax >= r1 && dmin <= r2)
+        {
+            lo = std::min(lo, ring);
+            hi = ring;
+        }
+    }
+    if (hi < 0)
+        return 0;
+    i0 = std::max(i0, strongholdRingStart(mc, lo));
+    i1 = std::min(i1, strongholdRingStart(mc, hi + 1));
+    if (i1 - i0 < cond->count)
+        return 0;
+
+    // when a single ring remains, check if its generation angles are suitable
+    if (strongholdRingOf(mc, i0) == strongholdRingOf(mc, i1-1) &&
+        !isRingOk(mc, seed, x1, z1, x2, z2, i0, i1, cond->count))
+        return 0;
+
+    // pre-biome-checks complete, the area appears to line up with possible generation positions
+    if (!g)
+    {
+        // TODO: warn if strongholds are used for relative positioning
+        sout->cx = 0;
+        sout->cz = 0;
+        return 1;
+    }
+
+    // the strongholds are shared with the other conditions of the seed, and
+    // the iteration stops as soon as the outcome is decided
+    SeedContext& sc = getSearchContext().seedctx;
+    const StrongholdIter *sh;
+    int qual = 0;
+    for (int i = 0; i < i1 && (sh = sc.getStronghold(mc, seed, g, i)); i++)
+    {
+        if (*abort)
+            break;
+        if (i < i0)
+            continue;
+
+        if (sh->pos.x >= x1 && sh->pos.x <= x2 && sh->pos.z >= z1 && sh->pos.z <= z2)
+        {
+            if (++qual >= cond->count)
+            {
+                sout->cx = sh->pos.x;
+                sout->cz = sh->pos.z;
+                return 1;
+            }
+        }
+        if (qual + (i1-1 - i) < cond->count)
+            break;
+    }
+    return 0;
+}
+
 int testCond(StructPos *spos, int64_t seed, const Condition *cond, int mc, LayerStack *g, std::atomic_bool *abort)
 {
     int x1, x2, z1, z2;
     int rx1, rx2, rz1, rz2, rx, rz;
     Pos pc;
     StructureConfig sconf;
-    int qual, valid;
-    int xt, zt;
-    int64_t s, r, rmin, rmax;
+    int qual;
+    int64_t s;
     Pos p[128];
 
     StructPos *sout = spos + cond->save;
@@ -182,80 +1176,13 @@ L_qm_any:
     case F_TREASURE:
     case F_PORTAL:
 
-        x1 = cond->x1;
-        z1 = cond->z1;
-        x2 = cond->x2;
-        z2 = cond->z2;
-        if (cond->relative)
-        {
-            x1 += spos[cond->relative].cx;
-            z1 += spos[cond->relative].cz;
-            x2 += spos[cond->relative].cx;
-            z2 += spos[cond->relative].cz;
-        }
-
-        if (sconf.regionSize == 32)
-        {
-            rx1 = x1 >> 9;
-            rz1 = z1 >> 9;
-            rx2 = x2 >> 9;
-            rz2 = z2 >> 9;
-        }
-        else if (sconf.regionSize == 1)
-        {
-            rx1 = x1 >> 4;
-            rz1 = z1 >> 4;
-            rx2 = x2 >> 4;
-            rz2 = z2 >> 4;
-        }
-        else
-        {
-            rx1 = (x1 / (sconf.regionSize << 4)) - (x1 < 0);
-            rz1 = (z1 / (sconf.regionSize << 4)) - (z1 < 0);
-            rx2 = (x2 / (sconf.regionSize << 4)) - (x2 < 0);
-            rz2 = (z2 / (sconf.regionSize << 4)) - (z2 < 0);
-        }
-
-        // TODO: warn if multistructure clusters are used as a positional
-        // dependency (the centre can change based on biomes)
-
-        sout->cx = xt = 0;
-        sout->cz = zt = 0;
-        qual = 0;
-
-        // Note "<="
-        for (rz = rz1; rz <= rz2 && !*abort; rz++)
-        {
-            for (rx = rx1; rx <= rx2; rx++)
-            {
-                if (!getStructurePos(sconf.structType, mc, seed, rx+0, rz+0, &pc))
-                    continue;
-                if (pc.x >= x1 && pc.x <= x2 && pc.z >= z1 && pc.z <= z2)
-                {
-                    if (g && !isViableStructurePos(sconf.structType, mc, g, seed, pc.x, pc.z))
-                        continue;
-
-                    xt += pc.x;
-                    zt += pc.z;
-
-                    if (++qual >= cond->count)
-                    {
-                        sout->sconf = sconf;
-                        sout->cx = xt / qual;
-                        sout->cz = zt / qual;
-                        return 1;
-                    }
-                }
-            }
-        }
-        return 0;
+        getStructArea(spos, cond, sconf, &x1, &z1, &x2, &z2, &rx1, &rz1, &rx2, &rz2);
+        return testStructArea(cond, sconf, mc, seed, g, sout, x1, z1, x2, z2, rx1, rz1, rx2, rz2, abort);
 
     case F_SPAWN:
         // TODO: warn if spawn is used for relative positioning
         sout->cx = 0;
         sout->cz = 0;
-        if (!g)
-            return 1;
 
         x1 = cond->x1;
         z1 = cond->z1;
@@ -268,9 +1195,14 @@ L_qm_any:
             x2 += spos[cond->relative].cx;
             z2 += spos[cond->relative].cz;
         }
-        applySeed(g, seed);
+        // the coarse biomes are much cheaper than the search for the spawn
+        // (in the 48-bit pass the position of a reference can still change)
+        if ((g || !cond->relative) && !isSpawnPossible(mc, seed, g, x1, z1, x2, z2))
+            return 0;
+        if (!g)
+            return 1;
         if (*abort) return 0;
-        pc = getSpawn(mc, g, NULL, seed);
+        pc = getSearchContext().seedctx.getSpawn(mc, seed, g);
         if (pc.x >= x1 && pc.x <= x2 && pc.z >= z1 && pc.z <= z2)
         {
             sout->cx = pc.x;
@@ -291,90 +1223,7 @@ L_qm_any:
             x2 += spos[cond->relative].cx;
             z2 += spos[cond->relative].cz;
         }
-        // TODO: add option for looking for the first stronghold only (which would be faster)
-
-        rx1 = abs(x1); rx2 = abs(x2);
-        rz1 = abs(z1); rz2 = abs(z2);
-        if (x1 <= 112 && x2 >= -112 && z1 <= 112 && z2 >= -112)
-        {
-            rmin = 0;
-        }
-        else
-        {
-            xt = (rx1 < rx2 ? rx1 : rx2) - 112;
-            zt = (rz1 < rz2 ? rz1 : rz2) - 112;
-            rmin = xt*xt + zt*zt;
-        }
-        xt = (rx1 > rx2 ? rx1 : rx2) + 112;
-        zt = (rz1 > rz2 ? rz1 : rz2) + 112;
-        rmax = xt*xt + zt*zt;
-
-        // -MC_1_8 formula:
-        // r = 640 + [0,1]*512 (+/-112)
-        // MC_1_9+ formula:
-        // r = 1408 + 3072*n + 1280*[0,1] (+/-112)
-
-        if (mc < MC_1_9)
-        {
-            if (rmax < 640*640 || rmin > 1152*1152)
-                return 0;
-            r = 0;
-            rmin = 640;
-            rmax = 1152;
-        }
-        else
-        {   // check if the area is entirely outside the radii ranges in which strongholds can generate
-            if (rmax < 1408*1408)
-                return 0;
-            rmin = sqrt(rmin);
-            rmax = sqrt(rmax);
-            r = (rmax - 1408) / 3072;       // maximum relevant ring number
-            if (rmax - rmin < 3072-1280)    // area does not span more than one ring
-            {
-                if (rmin > 1408+1280+3072*r)
-                    return 0;               // area is between rings
-            }
-            rmin = 1408;
-            rmax = 1408+1280;
-        }
-        // if we are only looking at the inner ring, we can check if the generation angles are suitable
-        if (r == 0 && !isInnerRingOk(mc, seed, x1, z1, x2, z2, rmin, rmax))
-            return 0;
-
-        // pre-biome-checks complete, the area appears to line up with possible generation positions
-        if (!g)
-        {
-            // TODO: warn if strongholds are used for relative positioning
-            sout->cx = 0;
-            sout->cz = 0;
-            return 1;
-        }
-        else
-        {
-            StrongholdIter sh;
-            initFirstStronghold(&sh, mc, seed);
-            applySeed(g, seed);
-            qual = 0;
-            while (nextStronghold(&sh, g, NULL) > 0)
-            {
-                if (*abort || sh.ringnum > r)
-                    break;
-
-                if (sh.pos.x >= x1 && sh.pos.x <= x2 && sh.pos.z >= z1 && sh.pos.z <= z2)
-                {
-                    if (++qual >= cond->count)
-                    {
-                        sout->cx = sh.pos.x;
-                        sout->cz = sh.pos.z;
-                        return 1;
-                    }
-                }
-
-                if (sh.ringnum == r && sh.ringidx+1 == sh.ringmax)
-                    break;
-            }
-        }
-        return 0;
+        return testStronghold(cond, mc, seed, g, sout, x1, z1, x2, z2, abort);
 
     case F_SLIME:
         if (cond->relative)
@@ -391,17 +1240,8 @@ L_qm_any:
             rx2 = cond->x2;
             rz2 = cond->z2;
         }
-        qual = 0;
-        for (int rz = rz1; rz <= rz2; rz++)
-        {
-            for (int rx = rx1; rx <= rx2; rx++)
-            {
-                if (isSlimeChunk(seed, rx, rz))
-                    if (++qual >= cond->count)
-                        return 1;
-            }
-        }
-        return 0;
+        qual = cond->count > 0 ? cond->count : 1;
+        return countSlime(seed, rx1, rz1, rx2, rz2, qual) >= qual;
 
     // biome filters reference specific layers
     // MAYBE: options for layers in different versions?
@@ -429,39 +1269,7 @@ L_biome_filter_any:
         }
         sout->cx = ((rx1 + rx2) << s) >> 1;
         sout->cz = ((rz1 + rz2) << s) >> 1;
-        if (!g)
-        {
-            if (finfo.layer != L_OCEAN_TEMP_256)
-                return 1;
-            if (mc < MC_1_13)
-                return 0;
-            thread_local LayerStack g_otemp;
-            if (!g_otemp.entry_1)
-                setupGenerator(&g_otemp, MC_1_13);
-            g = &g_otemp;
-        }
-        valid = 0;
-        if (rx2 >= rx1 || rz2 >= rz1 || !*abort)
-        {
-            int w = rx2-rx1+1;
-            int h = rz2-rz1+1;
-            int *area = allocCache(&g->layers[finfo.layer], w, h);
-            if (checkForBiomes(g, finfo.layer, area, seed, rx1, rz1, w, h, cond->bfilter, 0) > 0)
-            {
-                // check biome exclusion
-                uint64_t b = 0, bm = 0;
-                for (int i = 0; i < w*h; i++)
-                {
-                    int id = area[i];
-                    if (id < 128) b |= (1ULL << id);
-                    else bm |= (1ULL << (id-128));
-                }
-                if ((b & cond->exclb) == 0 && (bm & cond->exclm) == 0)
-                    valid = 1;
-            }
-            free(area);
-        }
-        return valid;
+        return testBiomeArea(cond, finfo.layer, mc, seed, g, rx1, rz1, rx2, rz2, abort);
 
 
     case F_TEMPS:
@@ -490,3 +1298,188 @@ L_biome_filter_any:
 
     return 1;
 }
+
+
+// region coordinate for a region size in chunks (0: not a power of two)
+template <int REG>
+static inline int blockToRegion(int x, int regsize)
+{
+    if (REG == 32)  return x >> 9;
+    if (REG == 1)   return x >> 4;
+    return (x / (regsize << 4)) - (x < 0);
+}
+
+template <int REG>
+static int evalStruct(const CompiledCond *cc, StructPos *spos, int64_t seed, LayerStack *g, std::atomic_bool *abort)
+{
+    const Condition *cond = cc->cond;
+    if (!cond->relative)
+    {
+        return testStructArea(cond, cc->sconf, cc->mc, seed, g, spos + cond->save,
+                cc->x1, cc->z1, cc->x2, cc->z2, cc->rx1, cc->rz1, cc->rx2, cc->rz2, abort);
+    }
+    const StructPos& ref = spos[cond->relative];
+    int x1 = cc->x1 + ref.cx, z1 = cc->z1 + ref.cz;
+    int x2 = cc->x2 + ref.cx, z2 = cc->z2 + ref.cz;
+    int reg = cc->sconf.regionSize;
+    return testStructArea(cond, cc->sconf, cc->mc, seed, g, spos + cond->save,
+            x1, z1, x2, z2, blockToRegion<REG>(x1, reg), blockToRegion<REG>(z1, reg),
+            blockToRegion<REG>(x2, reg), blockToRegion<REG>(z2, reg), abort);
+}
+
+// runs the implied coarse checks of a biome condition for the block area
+static bool isCoarseOk(const CompiledCond *cc, int64_t seed, LayerStack *g, int x1, int z1, int x2, int z2)
+{
+    SearchContext& ctx = getSearchContext();
+    const BiomePlan *plan = ctx.biomeplan;
+    if (plan && ctx.seedctx.hasBiomeGroup(plan->group[cc->cond->save]))
+        return true; // the fine area is already generated
+
+    LayerStack *gs = ctx.seedctx.getSeeded(seed, g);
+    for (int i = 0; i < cc->npre; i++)
+    {
+        const CoarseCheck& pre = cc->pre[i];
+        int cx1 = (x1 - pre.pad) >> pre.shift, cz1 = (z1 - pre.pad) >> pre.shift;
+        int cx2 = (x2 + pre.pad) >> pre.shift, cz2 = (z2 + pre.pad) >> pre.shift;
+        int w = cx2 - cx1 + 1, h = cz2 - cz1 + 1;
+        const Layer *layer = &gs->layers[pre.layer];
+        int *area = ctx.getArea(layer, w, h);
+        genArea(layer, area, cx1, cz1, w, h);
+        uint64_t b = 0, bm = 0;
+        for (int j = 0; j < w*h; j++)
+        {
+            int id = area[j];
+            if (id < 128) b |= (1ULL << id);
+            else bm |= (1ULL << (id-128));
+        }
+        if ((b & pre.incl) != pre.incl || (bm & pre.inclm) != pre.inclm)
+            return false;
+    }
+    return true;
+}
+
+// Derives the coarse checks of a biome include condition at 1:1 or 1:4. The
+// 1:1 biomes are picked from the neighbouring 1:4 cells. From 1:16 to 1:4
+// the zoom and smoothing layers move biomes by less than 32 blocks, but the
+// river and ocean mixing add biomes of their own, which are left out there.
+static void setupCoarseChecks(CompiledCond *cc, const Condition *c, int mc)
+{
+    uint64_t incl = c->bfilter.riverToFind | c->bfilter.oceanToFind;
+    uint64_t inclm = c->bfilter.riverToFindM;
+    int pad = 0;
+
+    cc->npre = 0;
+    if (cc->layer != L_VORONOI_1 && cc->layer != L_RIVER_MIX_4)
+        return;
+    if (cc->layer == L_VORONOI_1)
+        pad = 4;
+
+    if (mc >= MC_1_7)
+    {
+        uint64_t incl16 = incl;
+        incl16 &= ~((1ULL << river) | (1ULL << frozen_river) | (1ULL << mushroom_field_shore));
+        for (int id = 0; id < 64; id++)
+            if (isOceanic(id))
+                incl16 &= ~(1ULL << id);
+        if (incl16 || inclm)
+            cc->pre[cc->npre++] = CoarseCheck{ L_SHORE_16, 4, pad + 32, incl16, inclm };
+    }
+    if (cc->layer == L_VORONOI_1 && (incl || inclm))
+    {
+        int layer4 = mc >= MC_1_13 ? L_OCEAN_MIX_4 : L_RIVER_MIX_4;
+        cc->pre[cc->npre++] = CoarseCheck{ layer4, 2, pad, incl, inclm };
+    }
+}
+
+template <int S>
+static int evalBiome(const CompiledCond *cc, StructPos *spos, int64_t seed, LayerStack *g, std::atomic_bool *abort)
+{
+    const Condition *cond = cc->cond;
+    int rx1 = cc->rx1, rz1 = cc->rz1, rx2 = cc->rx2, rz2 = cc->rz2;
+    if (cond->relative)
+    {
+        const StructPos& ref = spos[cond->relative];
+        rx1 = ((cond->x1 << S) + ref.cx) >> S;
+        rz1 = ((cond->z1 << S) + ref.cz) >> S;
+        rx2 = ((cond->x2 << S) + ref.cx) >> S;
+        rz2 = ((cond->z2 << S) + ref.cz) >> S;
+    }
+    StructPos *sout = spos + cond->save;
+    sout->cx = ((rx1 + rx2) << S) >> 1;
+    sout->cz = ((rz1 + rz2) << S) >> 1;
+    if (g && cc->npre && !isCoarseOk(cc, seed, g, rx1 << S, rz1 << S,
+                                     ((rx2+1) << S) - 1, ((rz2+1) << S) - 1))
+        return 0;
+    return testBiomeArea(cond, cc->layer, cc->mc, seed, g, rx1, rz1, rx2, rz2, abort);
+}
+
+static int evalFail(const CompiledCond *, StructPos *, int64_t, LayerStack *, std::atomic_bool *)
+{
+    return 0;
+}
+
+static int evalAny(const CompiledCond *cc, StructPos *spos, int64_t seed, LayerStack *g, std::atomic_bool *abort)
+{
+    return testCond(spos, seed, cc->cond, cc->mc, g, abort);
+}
+
+// a slime condition relative to a position of the full seed, which the
+// 48-bit pass does not know yet
+static int evalFullSeed(const CompiledCond *cc, StructPos *spos, int64_t seed, LayerStack *g, std::atomic_bool *abort)
+{
+    return g ? testCond(spos, seed, cc->cond, cc->mc, g, abort) : 1;
+}
+
+void compileConditions(const Condition *cond, int ccnt, int mc, std::vector<CompiledCond> *prog, const int *cmc)
+{
+    prog->assign(ccnt, CompiledCond());
+    for (int i = 0; i < ccnt; i++)
+    {
+        CompiledCond& cc = (*prog)[i];
+        const Condition *c = cond + i;
+        const FilterInfo& finfo = g_filterinfo.list[c->type];
+        cc.cond = c;
+        cc.mc = cmc ? cmc[i] : mc;
+        cc.layer = finfo.layer;
+        cc.s48 = isCond48(cond, ccnt, i);
+        cc.eval = evalAny;
+        if (finfo.cat == CAT_48 && !cc.s48)
+            cc.eval = evalFullSeed;
+
+        if (isStructCond(c))
+        {
+            if (!getConfig(finfo.stype, cc.mc, &cc.sconf))
+            {
+                cc.eval = evalFail;
+                continue;
+            }
+            if (cc.sconf.regionSize == 32)
+                cc.eval = evalStruct<32>;
+            else if (cc.sconf.regionSize == 1)
+                cc.eval = evalStruct<1>;
+            else
+                cc.eval = evalStruct<0>;
+            // with the relative offsets applied per seed
+            StructPos zero[100] = {};
+            getStructArea(zero, c, cc.sconf, &cc.x1, &cc.z1, &cc.x2, &cc.z2,
+                          &cc.rx1, &cc.rz1, &cc.rx2, &cc.rz2);
+        }
+        else if (c->type >= F_BIOME && c->type <= F_BIOME_256_OTEMP)
+        {
+            switch (finfo.step)
+            {
+            case 1:     cc.eval = evalBiome<0>; break;
+            case 4:     cc.eval = evalBiome<2>; break;
+            case 16:    cc.eval = evalBiome<4>; break;
+            case 64:    cc.eval = evalBiome<6>; break;
+            case 256:   cc.eval = evalBiome<8>; break;
+            default:    continue;
+            }
+            cc.rx1 = c->x1;
+            cc.rz1 = c->z1;
+            cc.rx2 = c->x2;
+            cc.rz2 = c->z2;
+            setupCoarseChecks(&cc, c, cc.mc);
+        }
+    }
+}
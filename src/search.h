@@ -4,6 +4,7 @@
 #include "cubiomes/finders.h"
 
 #include <atomic>
+#include <vector>
 
 #define PRECOMPUTE48_BUFSIZ ((int64_t)1 << 30)
 
@@ -194,7 +195,7 @@ static const struct FilterList
         };
 
         list[F_SLIME] = FilterInfo{
-            CAT_FULL, 1, 1, 0, 0, 16, 1, MC_1_0,
+            CAT_48, 1, 1, 0, 0, 16, 1, MC_1_0,
             ":icons/slime.png",
             "Slime chunk",
             ""
@@ -315,14 +316,204 @@ struct Condition
     int count;
 };
 
+// Stronghold conditions have no use for the temperature counts, so temps[]
+// holds their selection instead: temps[SH_MODE] is one of the modes below
+// and temps[SH_ARG] is the number N or the ring (counted from 0).
+enum { SH_MODE = 0, SH_ARG = 1 };
+enum
+{
+    SH_ALL,         // any stronghold
+    SH_FIRST,       // one of the first N strongholds
+    SH_RING,        // a stronghold of the given ring
+};
+
 struct StructPos
 {
     StructureConfig sconf;
     int cx, cz; // effective center position
 };
 
+// Absolute biome conditions at the same layer with overlapping areas are
+// generated together, as one bounding rectangle for each seed, when that
+// rectangle is not larger than their separate areas combined.
+struct BiomeGroup
+{
+    int layer;
+    int x, z, w, h;     // bounding rectangle (at the scale of the layer)
+};
+
+struct BiomePlan
+{
+    std::vector<BiomeGroup> groups;
+    int group[100];     // group index by condition ID (-1: evaluated alone)
+};
+
+// 'cmc' optionally gives the MC version of each condition, as the conditions
+// of different versions are not grouped
+void setupBiomePlan(BiomePlan *plan, const Condition *cond, int ccnt, const int *cmc = NULL);
+
+// Values of a seed that several conditions can share, such as the seeded
+// layers, the spawn and the strongholds. They are computed on first use and
+// stay valid for as long as the same seed is tested with the same generator.
+struct SeedContext
+{
+    enum { MAX_STRONGHOLDS = 128 };
+
+    SeedContext() : seed(),g(),seeded(),hasspawn(),spawn(),shcnt(),shend(),sh(),shlist(),epoch(1),areas(),tiles64() {}
+
+    LayerStack *getSeeded(int64_t seed, LayerStack *g);
+    Pos getSpawn(int mc, int64_t seed, LayerStack *g);
+    // the iterator state after the i-th call of nextStronghold(), or NULL
+    // once there are no further strongholds
+    const StrongholdIter *getStronghold(int mc, int64_t seed, LayerStack *g, int i);
+    // the generated area of a biome group
+    const int *getBiomeGroup(const BiomePlan *plan, int gi, int64_t seed, LayerStack *g);
+    // the 1:64 biome of a cell (at L_SUNFLOWER_64), generated in cached tiles
+    int getBiome64(int64_t seed, LayerStack *g, int cx, int cz);
+    bool hasBiomeGroup(int gi) const
+    {
+        return gi >= 0 && gi < (int) areas.size() && areas[gi].epoch == epoch;
+    }
+
+    void use(int64_t seed, LayerStack *g)
+    {
+        if (seed != this->seed || g != this->g)
+        {
+            this->seed = seed;
+            this->g = g;
+            seeded = hasspawn = false;
+            shcnt = -1;
+            shend = false;
+            epoch++;
+        }
+    }
+
+    int64_t         seed;
+    LayerStack    * g;
+    bool            seeded;     // applySeed() was called for the seed
+    bool            hasspawn;
+    Pos             spawn;
+    int             shcnt;      // number of strongholds iterated (-1: not started)
+    bool            shend;
+    StrongholdIter  sh;
+    StrongholdIter  shlist[MAX_STRONGHOLDS];
+    uint64_t        epoch;      // incremented for each new seed
+
+    struct GroupArea
+    {
+        uint64_t epoch;         // the area is valid for this epoch
+        std::vector<int> buf;
+    };
+    std::vector<GroupArea> areas; // by biome group
+
+    enum { TILE64 = 16, TILES64 = 16 };
+    struct Tile64
+    {
+        uint64_t epoch;
+        int tx, tz;
+        int ids[TILE64*TILE64];
+    };
+    std::vector<Tile64> tiles64;  // direct mapped by tile position
+};
+
+// Scratch state of a search thread that persists across search items, so that
+// neither the items nor the conditions have to set up generators or allocate
+// buffers for each seed. Every thread has its own (see getSearchContext()).
+struct SearchContext
+{
+    SearchContext() : gen(),spos(),seedctx(),biomeplan(),area(),areasiz(),spawnpot(),viablepot() {}
+    ~SearchContext();
+
+    LayerStack *getGenerator(int mc);               // set up on first use
+    int *getArea(const Layer *layer, int w, int h); // grow-only biome buffer
+    const char *getSpawnPotential(int mc);          // 1:64 biomes that can become spawn biomes
+    const char *getViablePotential(int stype, int mc); // 1:64 biomes that can become viable for a structure (NULL: any)
+
+    std::vector<LayerStack*> gen;   // generators by MC version
+    StructPos spos[100];            // condition positions by condition ID
+    SeedContext seedctx;            // shared values of the seed under test
+    const BiomePlan *biomeplan;     // biome groups of the current search (optional)
+    int *area;
+    size_t areasiz;
+    // the potentials are kept by MC version, as a search can alternate between versions
+    std::vector<std::vector<char>> spawnpot;    // empty: not set up
+    std::vector<std::vector<char>> viablepot;   // by structure type: 0 not set up, 1 any biome, 2 listed in the following 256
+};
+
+SearchContext& getSearchContext();
+
+// Measured evaluation counters of a condition in one pass of a search.
+struct CondProfile
+{
+    int save;           // condition ID
+    int pass;           // 0: with the 48-bit seed, 1: with the full seed
+    uint64_t calls;
+    uint64_t passed;
+    double nsec;        // estimated total evaluation time
+};
+
 
 int testCond(StructPos *spos, int64_t seed, const Condition *cond, int mc, LayerStack *g, std::atomic_bool *abort);
 
+// An include check at a coarser layer that a biome condition implies: the
+// included biomes have to be present there already, within the area of the
+// condition padded by how far the finer layers can shift them.
+struct CoarseCheck
+{
+    int                 layer;
+    int                 shift;          // scale of the layer (log2)
+    int                 pad;            // padding in blocks
+    uint64_t            incl, inclm;    // biomes that have to be present
+};
+
+// A condition with what does not depend on the seed resolved ahead of the
+// search (configuration, region bounds, scale) and an evaluator specialised
+// for its filter family and region size. Evaluates like testCond().
+struct CompiledCond
+{
+    typedef int (*Eval)(const CompiledCond *cc, StructPos *spos, int64_t seed, LayerStack *g, std::atomic_bool *abort);
+
+    Eval                eval;
+    const Condition   * cond;
+    int                 mc;
+    int                 layer;          // generator layer of a biome filter
+    bool                s48;            // decided by the lower 48 bits of the seed (see isCond48())
+    StructureConfig     sconf;          // configuration of a structure filter
+    int x1, z1, x2, z2;                 // block area (of an absolute condition)
+    int rx1, rz1, rx2, rz2;             // area at the filter scale (of an absolute condition)
+    CoarseCheck         pre[2];         // implied checks of a biome filter, run first
+    int                 npre;
+};
+
+// compiles cond[0..ccnt) into prog, at the same indices ('cmc' optionally
+// gives the MC version of each condition)
+void compileConditions(const Condition *cond, int ccnt, int mc, std::vector<CompiledCond> *prog,
+                       const int *cmc = NULL);
+
+inline int testCompiled(const CompiledCond *cc, StructPos *spos, int64_t seed, LayerStack *g, std::atomic_bool *abort)
+{
+    return cc->eval(cc, spos, seed, g, abort);
+}
+
+// The candidate positions of a structure condition only depend on the lower
+// 48 bits of the seed. For a block of seeds they can be listed once (in the
+// order of testCond), and the seeds then only check their viability.
+bool isStructCond(const Condition *cond);
+// Whether cond[i] is decided by the lower 48 bits of the seed. A slime
+// condition only is when its reference chain is, as its area follows the
+// reference position.
+bool isCond48(const Condition *cond, int ccnt, int i);
+void getCondPositions(const StructPos *spos, int64_t seed, const Condition *cond, int mc, std::vector<Pos> *pos);
+int testCondPositions(StructPos *spos, int64_t seed, const Condition *cond, int mc, LayerStack *g,
+        const Pos *pos, int n, std::atomic_bool *abort);
+
+// The residues of the lower 'bits' bits that a 48-bit seed needs for the
+// (absolute) structure conditions to be met, in increasing order. The rare
+// seeds that can meet them with other lower bits, through the rejection step
+// of nextInt(), are returned in 'extra' (sorted). Returns false when no
+// condition restricts the lower bits usefully.
+bool getLow48Residues(const Condition *cond, int ccnt, int mc, int *bits, std::vector<uint32_t> *res,
+                      std::vector<int64_t> *extra);
+
 
 #endif // SEARCH_H
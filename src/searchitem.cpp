@@ -1,33 +1,73 @@
 #include "searchitem.h"
 #include "seedtables.h"
+#include "cutil.h"
 
-#include <QMessageBox>
 #include <QStandardPaths>
 
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// the automatic item size aims for this processing time per item
+#define ITEM_TARGET_NSEC    (250 * 1000000LL)
+#define ITEM_AUTO_INIT      64
+#define ITEM_AUTO_MAX       (1 << 24)
+// minimum number of samples of each condition for a reordering
+#define PLAN_MIN_CALLS      16
+
 
 SearchItem::~SearchItem()
 {
     if (searchtype >= 0)
-        emit canceled(itemid);
+    {
+        ItemResult *r = new ItemResult();
+        r->range = range;
+        r->itemid = itemid;
+        r->isdone = false;
+        r->canceled = true;
+        r->pos = pos;
+        r->cnt = 0;
+        r->nsec = 0;
+        queue->push(r);
+    }
 }
 
 void SearchItem::run()
 {
-    LayerStack g;
-    setupGenerator(&g, mc);
-    StructPos spos[100] = {};
+    // the generator and the scratch space are kept by the pool thread
+    SearchContext& ctx = getSearchContext();
+    LayerStack& g = *ctx.getGenerator(mc);
+    StructPos *spos = ctx.spos;
+    ctx.biomeplan = biomeplan;
+    setupGenerators(ctx);
     QVector<int64_t> matches;
+    QVector<uint32_t> matchq;
+    auto match = [&](int64_t s, uint32_t q) {
+        matches.push_back(s);
+        if (multiq)
+            matchq.push_back(q);
+    };
+    uint32_t q;
+    int64_t cnt = 0;
+    QElapsedTimer timer;
+    timer.start();
 
-    if (searchtype == SEARCH_LIST)
+    // the seeds are claimed one at a time, as the end of the range may be
+    // split off by the controller while the item is running
+
+    if (searchtype == SEARCH_LIST || (searchtype == SEARCH_TEXT && slist))
     {   // seed = slist[..]
-        int64_t ie = idx+scnt < len ? idx+scnt : len;
-        for (int64_t i = idx; i < ie; i++)
+        int64_t i = idx;
+        while (i < len && range->claim())
         {
-            seed = slist[i];
-            if (testSeed(spos, seed, &g, true))
-                matches.push_back(seed);
+            seed = slist[i++];
+            range->seed.store(seed, std::memory_order_relaxed);
+            if (testSeed(spos, seed, &g, true) && (q = testQueries(spos, seed, &g, qall, true)))
+                match(seed, q);
+            cnt++;
         }
-        isdone = (ie == len);
+        isdone = (i == len);
     }
 
     if (searchtype == SEARCH_INC)
@@ -37,12 +77,18 @@ void SearchItem::run()
             int64_t high = (sstart >> 48) & 0xffff;
             int64_t lowidx = idx;
 
-            for (int i = 0; i < scnt; i++)
+            while (range->claim())
             {
                 seed = (high << 48) | slist[lowidx];
+                range->seed.store(seed, std::memory_order_relaxed);
 
-                if (testSeed(spos, seed, &g, true))
-                    matches.push_back(seed);
+                const StructPos *sp = spos48 + lowidx * n48;
+                for (int i = 0; i < n48; i++)
+                    spos[save48[i]] = sp[i];
+
+                if (testSeed(spos, seed, &g, !s48done) && (q = testQueries(spos, seed, &g, qall, true)))
+                    match(seed, q);
+                cnt++;
 
                 if (++lowidx >= len)
                 {
@@ -58,10 +104,12 @@ void SearchItem::run()
         else
         {   // seed++
             seed = sstart;
-            for (int i = 0; i < scnt; i++)
+            while (range->claim())
             {
-                if (testSeed(spos, seed, &g, true))
-                    matches.push_back(seed);
+                range->seed.store(seed, std::memory_order_relaxed);
+                if (testSeed(spos, seed, &g, true) && (q = testQueries(spos, seed, &g, qall, true)))
+                    match(seed, q);
+                cnt++;
 
                 if (seed == ~(int64_t)0)
                 {
@@ -73,6 +121,27 @@ void SearchItem::run()
         }
     }
 
+    if (searchtype == SEARCH_TEXT && !slist)
+    {   // seed = (int32_t) hash
+        uint32_t h = (uint32_t) sstart;
+        while (range->claim())
+        {
+            seed = (int32_t) h;
+            range->seed.store(seed, std::memory_order_relaxed);
+            if (isLowOk(h) &&
+                testSeed(spos, seed, &g, true) && (q = testQueries(spos, seed, &g, qall, true)))
+                match(seed, q);
+            cnt++;
+
+            if (h == 0xffffffff)
+            {
+                isdone = true;
+                break;
+            }
+            h++;
+        }
+    }
+
     if (searchtype == SEARCH_BLOCKS)
     {   // seed = ([..] << 48) | low
         do
@@ -95,13 +164,25 @@ void SearchItem::run()
                 // warning: block search should only cover candidates
                 break;
             }
+            // the queries that are still possible for this block
+            uint32_t alive = testQueries(spos, low, NULL, qall, true);
+            if (!alive)
+                break;
+
+            blockpos.resize(ccnt);
+            for (int i : orderfull)
+                if (blockcond[i])
+                    getCondPositions(spos, low, cond + i, mc, &blockpos[i]);
+            useblockpos = true;
 
-            for (int i = 0; i < scnt; i++)
+            while (range->claim())
             {
                 seed = (high << 48) | low;
+                range->seed.store(seed, std::memory_order_relaxed);
 
-                if (testSeed(spos, seed, &g, false))
-                    matches.push_back(seed);
+                if (testSeed(spos, seed, &g, false) && (q = testQueries(spos, seed, &g, alive, false)))
+                    match(seed, q);
+                cnt++;
 
                 if (++high >= 0x10000)
                     break;
@@ -110,36 +191,450 @@ void SearchItem::run()
         while (0);
     }
 
-    if (!matches.empty())
+    ctx.biomeplan = NULL;
+
+    ItemResult *r = new ItemResult();
+    r->range = range;
+    r->itemid = itemid;
+    r->isdone = isdone;
+    r->canceled = false;
+    r->pos = pos;
+    r->cnt = cnt;
+    r->nsec = timer.nsecsElapsed();
+    r->matches.swap(matches);
+    r->matchq.swap(matchq);
+    r->stats.swap(stats);
+    r->planstats.swap(planstats);
+    searchtype = -1;
+    queue->push(r);
+}
+
+
+uint32_t SearchItem::testQueryConds(StructPos *spos, int64_t seed, LayerStack *g, uint32_t alive, bool s48check)
+{
+    // a condition is evaluated once for all the queries that have it, and the
+    // indices keep the relative conditions after the ones they refer to
+    uint32_t fail = ~alive;
+    const CompiledCond *pc = prog + ccnt;
+    if (s48check)
     {
-        emit results(matches, false);
+        for (int i = 0; i < tcnt; i++)
+        {
+            if ((qmask[i] & ~fail) && !testCompiled(pc + i, spos, seed, NULL, abort))
+                if ((fail |= qmask[i]) == ~(uint32_t)0)
+                    return 0;
+        }
     }
-    emit itemDone(itemid, seed, isdone);
-    searchtype = -1;
+    if (g)
+    {
+        for (int i = 0; i < tcnt; i++)
+        {
+            if (pc[i].s48)
+                continue;
+            LayerStack *gi = tgen.empty() ? g : tgen[i];
+            if ((qmask[i] & ~fail) && !testCompiled(pc + i, spos, seed, gi, abort))
+                if ((fail |= qmask[i]) == ~(uint32_t)0)
+                    return 0;
+        }
+    }
+    return ~fail & alive;
+}
+
+static inline int64_t nsecNow()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool SearchItem::timeSeed(StructPos *spos, int64_t seed, LayerStack *g, bool s48check)
+{
+    if (profile)
+        return profileSeed(spos, seed, g, s48check);
+
+    if (s48check)
+    {
+        for (int i : order48)
+        {
+            CondStat& st = stats[i];
+            int64_t t = nsecNow();
+            int r = testCompiled(prog + i, spos, seed, NULL, abort);
+            st.nsec += nsecNow() - t;
+            st.timed++;
+            st.calls++;
+            if (!r)
+                return false;
+            st.passed++;
+        }
+    }
+    for (int i : orderfull)
+    {
+        CondStat& st = stats[ccnt + i];
+        int64_t t = nsecNow();
+        int r = testFullCond(spos, seed, i, g);
+        st.nsec += nsecNow() - t;
+        st.timed++;
+        st.calls++;
+        if (!r)
+            return false;
+        st.passed++;
+    }
+    return true;
+}
+
+bool SearchItem::profileSeed(StructPos *spos, int64_t seed, LayerStack *g, bool s48check)
+{
+    // the counters only include the calls that testSeed() would have made
+    bool ok = true;
+    if (s48check)
+    {
+        for (int i : order48)
+        {
+            int64_t t = nsecNow();
+            int r = testCompiled(prog + i, spos, seed, NULL, abort);
+            t = nsecNow() - t;
+            CondStat& pst = planstats[i];
+            pst.nsec += t;
+            pst.timed++;
+            pst.calls++;
+            pst.passed += (r != 0);
+            if (ok)
+            {
+                CondStat& st = stats[i];
+                st.nsec += t;
+                st.timed++;
+                st.calls++;
+                st.passed += (r != 0);
+            }
+            ok &= (r != 0);
+        }
+        if (!ok)
+            return false;
+    }
+    for (int i : orderfull)
+    {
+        int64_t t = nsecNow();
+        int r = testFullCond(spos, seed, i, g);
+        t = nsecNow() - t;
+        CondStat& pst = planstats[ccnt + i];
+        pst.nsec += t;
+        pst.timed++;
+        pst.calls++;
+        pst.passed += (r != 0);
+        if (ok)
+        {
+            CondStat& st = stats[ccnt + i];
+            st.nsec += t;
+            st.timed++;
+            st.calls++;
+            st.passed += (r != 0);
+        }
+        ok &= (r != 0);
+    }
+    return ok;
 }
 
 
 void SearchItemGenerator::init(
     QObject *mainwin, int mc, const Condition *cond, int ccnt,
     Gen48Settings gen48, const std::vector<int64_t>& seedlist,
-    int itemsize, int searchtype, int64_t sstart)
+    int itemsize, int searchtype, int64_t sstart, int threads,
+    int tcnt, const uint32_t *qmask, int qcnt,
+    const int *tmc)
 {
+    scan48.stop();
+
     this->mainwin = mainwin;
     this->searchtype = searchtype;
     this->mc = mc;
     this->cond = cond;
     this->ccnt = ccnt;
+    this->tcnt = tcnt;
+    this->qcnt = qcnt;
+    this->qmask.assign(qmask, qmask + tcnt);
+    this->tmc.clear();
+    if (tmc)
+        this->tmc.assign(tmc, tmc + tcnt);
     this->itemid = 0;
-    this->itemsiz = itemsize;
+    this->itemsiz = itemsize > 0 ? itemsize : ITEM_AUTO_INIT;
+    this->autosize = itemsize <= 0;
+    this->autowin = 1;
+    this->autocnt = 0;
+    this->autoseeds = 0;
+    this->autonsec = 0;
+    this->threads = threads;
     this->slist = seedlist;
     this->gen48 = gen48;
     this->idx = 0;
     this->scnt = ~(uint64_t)0;
     this->seed = sstart;
     this->isdone = false;
+    this->done.clear();
+    this->lowok.clear();
+    this->lowextra.clear();
+    std::vector<int> cmc(ccnt + tcnt, mc);
+    for (int i = 0; i < (int) this->tmc.size(); i++)
+        cmc[ccnt + i] = this->tmc[i];
+    setupBiomePlan(&biomeplan, cond, ccnt + tcnt, cmc.data());
+    compileConditions(cond, ccnt + tcnt, mc, &prog, cmc.data());
+    this->order48.clear();
+    this->orderfull.clear();
+    for (int i = 0; i < ccnt; i++)
+    {
+        order48.push_back(i);
+        // the shared conditions of a version search only filter the 48-bit
+        // seeds, and are tested with the full seed in each version
+        if (!prog[i].s48 && !tmc)
+            orderfull.push_back(i);
+    }
+    this->timing = false;
+    this->profile = false;
+    this->filtered48 = false;
+    this->save48.clear();
+    this->spos48.clear();
+    this->blockcond.assign(ccnt, 0);
+    for (int i = 0; searchtype == SEARCH_BLOCKS && i < ccnt; i++)
+    {
+        // the positions must not depend on the biomes of the full seed
+        const Condition& c = cond[i];
+        bool fixed = c.relative == 0;
+        for (int j = 0; j < ccnt; j++)
+            if (cond[j].save == c.relative)
+                fixed = prog[j].s48;
+        blockcond[i] = isStructCond(&c) && fixed;
+    }
+}
+
+
+bool checkConditions(const QVector<Condition>& cv, int mc, QString *err, QStringList *info)
+{
+    char refbuf[100] = {};
+
+    for (const Condition& c : cv)
+    {
+        if (c.save < 1 || c.save > 99)
+        {
+            *err = QString::asprintf("Condition with invalid ID [%02d].", c.save);
+            return false;
+        }
+        if (c.relative && refbuf[c.relative] == 0)
+        {
+            *err = QString::asprintf(
+                    "Condition with ID [%02d] has a broken reference position:\n"
+                    "condition missing or out of order.", c.save);
+            return false;
+        }
+        if (++refbuf[c.save] > 1)
+        {
+            *err = QString::asprintf("More than one condition with ID [%02d].", c.save);
+            return false;
+        }
+        if (c.type < 0 || c.type >= FILTER_MAX)
+        {
+            *err = QString::asprintf("Encountered invalid filter type %d in condition ID [%02d].", c.type, c.save);
+            return false;
+        }
+        if (mc < g_filterinfo.list[c.type].mcmin)
+        {
+            const char *mcs = mc2str(g_filterinfo.list[c.type].mcmin);
+            *err = QString::asprintf("Condition [%02d] requires a minimum Minecraft version of %s.", c.save, mcs);
+            return false;
+        }
+        if (c.type >= F_BIOME && c.type <= F_BIOME_256_OTEMP)
+        {
+            if ((c.exclb & (c.bfilter.riverToFind | c.bfilter.oceanToFind)) ||
+                (c.exclm & c.bfilter.riverToFindM))
+            {
+                *err = QString::asprintf("Biome filter condition with ID [%02d] has contradicting flags for include and exclude.", c.save);
+                return false;
+            }
+            // TODO: compare mc version and available biomes
+            if (c.count == 0)
+            {
+                info->append(QString::asprintf("Biome filter condition with ID [%02d] specifies no biomes.", c.save));
+            }
+        }
+        if (c.type == F_TEMPS)
+        {
+            int w = c.x2 - c.x1 + 1;
+            int h = c.z2 - c.z1 + 1;
+            if (c.count > w * h)
+            {
+                *err = QString::asprintf(
+                        "Temperature category condition with ID [%02d] has too many restrictions (%d) for the area (%d x %d).",
+                        c.save, c.count, w, h);
+                return false;
+            }
+        }
+    }
+
+    return true;
 }
 
 
+bool mergeQueries(const QVector<QVector<Condition>>& queries, QVector<Condition> *merged,
+                  int *shared, std::vector<uint32_t> *qmask, QString *err)
+{
+    int qcnt = queries.size();
+    if (qcnt < 1 || qcnt > MAX_QUERIES)
+    {
+        *err = QString::asprintf("A search takes from 1 to %d queries.", MAX_QUERIES);
+        return false;
+    }
+
+    std::vector<Condition> uniq;
+    std::vector<uint32_t> mask;
+    bool used[100] = {};
+
+    for (int q = 0; q < qcnt; q++)
+    {
+        const QVector<Condition>& cv = queries[q];
+        int ids[100] = {};      // new IDs by the IDs of the query
+        std::vector<char> placed(cv.size());
+        int n = 0;
+        // the conditions are placed after the ones they are relative to,
+        // and compare equal if they refer to the same (merged) condition
+        while (n < cv.size())
+        {
+            int prev = n;
+            for (int i = 0; i < cv.size(); i++)
+            {
+                const Condition& c = cv[i];
+                if (placed[i] || (c.relative && !ids[c.relative]))
+                    continue;
+                Condition k;
+                memcpy(&k, &c, sizeof(Condition));
+                k.relative = c.relative ? ids[c.relative] : 0;
+                size_t j;
+                for (j = 0; j < uniq.size(); j++)
+                {
+                    k.save = uniq[j].save;
+                    if (memcmp(&k, &uniq[j], sizeof(Condition)) == 0)
+                        break;
+                }
+                if (j == uniq.size())
+                {
+                    int id = c.save;
+                    for (int t = 1; used[id] && t < 100; t++)
+                        id = t;
+                    if (used[id])
+                    {
+                        *err = "The queries have too many different conditions.";
+                        return false;
+                    }
+                    used[id] = true;
+                    k.save = id;
+                    uniq.push_back(k);
+                    mask.push_back(0);
+                }
+                mask[j] |= 1u << q;
+                ids[c.save] = uniq[j].save;
+                placed[i] = 1;
+                n++;
+            }
+            if (n == prev)
+            {
+                *err = QString::asprintf("Query %d has conditions with unresolved relative positions.", q);
+                return false;
+            }
+        }
+    }
+
+    uint32_t all = ~(uint32_t)0 >> (32 - qcnt);
+    merged->clear();
+    qmask->clear();
+    for (size_t j = 0; j < uniq.size(); j++)
+        if (mask[j] == all)
+            merged->push_back(uniq[j]);
+    *shared = merged->size();
+    for (size_t j = 0; j < uniq.size(); j++)
+    {
+        if (mask[j] != all)
+        {
+            merged->push_back(uniq[j]);
+            qmask->push_back(mask[j]);
+        }
+    }
+    return true;
+}
+
+bool splitVersions(const QVector<Condition>& cv, const QVector<int>& mcs, QVector<Condition> *merged,
+                   int *shared, std::vector<uint32_t> *qmask, std::vector<int> *tmc, QString *err)
+{
+    int vcnt = mcs.size();
+    if (vcnt < 1 || vcnt > MAX_QUERIES)
+    {
+        *err = QString::asprintf("A search takes from 1 to %d versions.", MAX_QUERIES);
+        return false;
+    }
+
+    enum { SHARED = 1, FILTER48, COPIED };
+    char kind[100] = {};    // by condition ID
+    bool used[100] = {};
+    for (const Condition& c : cv)
+        used[c.save] = true;
+
+    // the conditions come after the ones they are relative to
+    for (int i = 0; i < cv.size(); i++)
+    {
+        const Condition& c = cv[i];
+        const FilterInfo& finfo = g_filterinfo.list[c.type];
+        bool same = !c.relative || kind[c.relative] != COPIED;
+        if (same && finfo.stype > 0)
+        {
+            StructureConfig sc0, sc;
+            same = getConfig(finfo.stype, mcs[0], &sc0);
+            for (int v = 1; same && v < vcnt; v++)
+                same = getConfig(finfo.stype, mcs[v], &sc) && memcmp(&sc, &sc0, sizeof(sc)) == 0;
+        }
+        if (same && isCond48(cv.constData(), cv.size(), i) && finfo.layer == 0)
+            kind[c.save] = SHARED;
+        else if (same && isStructCond(&c))
+            kind[c.save] = FILTER48;
+        else
+            kind[c.save] = COPIED;
+    }
+
+    merged->clear();
+    qmask->clear();
+    tmc->clear();
+    for (const Condition& c : cv)
+        if (kind[c.save] != COPIED)
+            merged->push_back(c);
+    *shared = merged->size();
+
+    for (int v = 0; v < vcnt; v++)
+    {
+        int ids[100] = {};      // IDs of the copies in this version
+        for (const Condition& c : cv)
+        {
+            if (kind[c.save] == SHARED)
+                continue;
+            Condition k;
+            memcpy(&k, &c, sizeof(Condition));
+            if (v > 0 || kind[c.save] == FILTER48)
+            {
+                int id = 1;
+                while (id < 100 && used[id])
+                    id++;
+                if (id == 100)
+                {
+                    *err = "The condition IDs do not suffice for the copies of these versions.";
+                    return false;
+                }
+                used[id] = true;
+                k.save = id;
+            }
+            if (c.relative && ids[c.relative])
+                k.relative = ids[c.relative];
+            ids[c.save] = k.save;
+            merged->push_back(k);
+            qmask->push_back(1u << v);
+            tmc->push_back(mcs[v]);
+        }
+    }
+    return true;
+}
+
 static int check(int64_t s48, void *data)
 {
     (void) data;
@@ -190,31 +685,33 @@ static void genQHBases(QObject *qtobj, int qual, int64_t salt, std::vector<int64
 
     if ((qb = loadSavedSeeds(fnam.data(), &qn)) == NULL)
     {
-        printf("Writing quad-protobases to: %s\n", fnam.data());
-        fflush(stdout);
+        fprintf(stderr, "Writing quad-protobases to: %s\n", fnam.data());
 
-        QMetaObject::invokeMethod(qtobj, "openProtobaseMsg", Qt::QueuedConnection, Q_ARG(QString, path));
+        if (qtobj)
+            QMetaObject::invokeMethod(qtobj, "openProtobaseMsg", Qt::QueuedConnection, Q_ARG(QString, path));
 
         int threads = QThread::idealThreadCount();
         int err = searchAll48(&qb, &qn, fnam.data(), threads, lbset, lbcnt, 20, check, NULL);
 
         if (err)
         {
-            QMetaObject::invokeMethod(
-                    qtobj, "warning", Qt::BlockingQueuedConnection,
-                    Q_ARG(QString, QString("Warning")),
-                    Q_ARG(QString, QString("Failed to generate protobases.")));
+            if (qtobj)
+                QMetaObject::invokeMethod(
+                        qtobj, "warning", Qt::BlockingQueuedConnection,
+                        Q_ARG(QString, QString("Warning")),
+                        Q_ARG(QString, QString("Failed to generate protobases.")));
+            else
+                fprintf(stderr, "Failed to generate protobases.\n");
             return;
         }
-        else
+        else if (qtobj)
         {
             QMetaObject::invokeMethod(qtobj, "closeProtobaseMsg", Qt::BlockingQueuedConnection);
         }
     }
     else
     {
-        printf("Loaded quad-protobases from: %s\n", fnam.data());
-        fflush(stdout);
+        fprintf(stderr, "Loaded quad-protobases from: %s\n", fnam.data());
     }
 
     if (qb)
@@ -227,11 +724,10 @@ static void genQHBases(QObject *qtobj, int qual, int64_t salt, std::vector<int64
     }
 }
 
-// Produces a list of seed bases from precomputed lists, provided all candidates fit into a buffer.
-bool getQuadCandidates(std::vector<int64_t>& list48, QObject *qtobj, Gen48Settings gen48, int mc, int64_t bufmax)
+// The quad bases of the gen48 settings, as sorted and unique 48-bit values.
+static bool getQuadBases(std::vector<int64_t>& qlist, QObject *qtobj, Gen48Settings gen48, int mc)
 {
-    std::vector<int64_t> qlist;
-    list48.clear();
+    qlist.clear();
 
     if (gen48.mode == GEN48_QH)
     {
@@ -252,8 +748,18 @@ bool getQuadCandidates(std::vector<int64_t>& list48, QObject *qtobj, Gen48Settin
                 qlist.push_back(qb[i]);
     }
 
-    if (qlist.empty())
-        return false;
+    for (int64_t& b : qlist)
+        b &= MASK48;
+    std::sort(qlist.begin(), qlist.end());
+    qlist.erase(std::unique(qlist.begin(), qlist.end()), qlist.end());
+    return !qlist.empty();
+}
+
+// Produces a list of seed bases from the quad bases, provided all candidates fit into a buffer.
+static bool getQuadCandidates(std::vector<int64_t>& list48, const std::vector<int64_t>& qlist,
+                              Gen48Settings gen48, int64_t bufmax)
+{
+    list48.clear();
 
     int x = gen48.x1;
     int z = gen48.z1;
@@ -284,12 +790,94 @@ bool getQuadCandidates(std::vector<int64_t>& list48, QObject *qtobj, Gen48Settin
 }
 
 
+void CandidateMerge::init(const std::vector<int64_t>& bases, int x, int z, int w, int h)
+{
+    this->bases = bases;
+    streams.clear();
+    if (bases.empty())
+        return;
+    for (int j = 0; j < h; j++)
+    {
+        for (int i = 0; i < w; i++)
+        {
+            Stream st;
+            st.off = moveStructure(0, x+i, z+j);
+            // the bases that wrap around 2^48 come first
+            st.start = std::lower_bound(bases.begin(), bases.end(), (MASK48 + 1) - st.off) - bases.begin();
+            st.pos = 0;
+            streams.push_back(st);
+        }
+    }
+    seek(0);
+}
+
+void CandidateMerge::seek(int64_t low)
+{
+    typedef std::pair<int64_t, int> Entry;
+    size_t n = bases.size();
+    heap.clear();
+    for (int i = 0; i < (int) streams.size(); i++)
+    {
+        Stream& st = streams[i];
+        size_t lo = 0, hi = n;
+        while (lo < hi)
+        {
+            st.pos = (lo + hi) / 2;
+            if (value(st) < low)
+                lo = st.pos + 1;
+            else
+                hi = st.pos;
+        }
+        st.pos = lo;
+        if (st.pos < n)
+            heap.push_back(Entry(value(st), i));
+    }
+    std::make_heap(heap.begin(), heap.end(), std::greater<Entry>());
+    last = -1;
+}
+
+bool CandidateMerge::next(int64_t *s48)
+{
+    typedef std::pair<int64_t, int> Entry;
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+        Entry e = heap.back();
+        heap.pop_back();
+        Stream& st = streams[e.second];
+        if (++st.pos < bases.size())
+        {
+            heap.push_back(Entry(value(st), e.second));
+            std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+        }
+        if (e.first != last)
+        {
+            last = e.first;
+            *s48 = e.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+
 void SearchItemGenerator::presearch()
 {
     int64_t sstart = seed;
 
+    merge48 = CandidateMerge();
     if (slist.empty() && searchtype != SEARCH_LIST)
-        getQuadCandidates(slist, mainwin, gen48, mc, PRECOMPUTE48_BUFSIZ);
+    {
+        std::vector<int64_t> qlist;
+        if (getQuadBases(qlist, mainwin, gen48, mc) &&
+            !getQuadCandidates(slist, qlist, gen48, PRECOMPUTE48_BUFSIZ) &&
+            searchtype == SEARCH_BLOCKS)
+        {   // too many candidates for a list: merge them as the search goes
+            // (an incremental search would have to merge them again for each
+            // of the upper 16 bits, so it tests all the seeds instead)
+            merge48.init(qlist, gen48.x1, gen48.z1, gen48.x2 - gen48.x1 + 1, gen48.z2 - gen48.z1 + 1);
+        }
+    }
 
     if (searchtype == SEARCH_LIST && !slist.empty())
     {
@@ -304,6 +892,14 @@ void SearchItemGenerator::presearch()
 
     if (searchtype == SEARCH_INC)
     {
+        if (!slist.empty())
+            filter48();
+        if (filtered48 && slist.empty())
+        {
+            scnt = 0;
+            isdone = true;
+            return;
+        }
         if (!slist.empty())
         {
             scnt = 0x10000 * slist.size();
@@ -326,6 +922,54 @@ void SearchItemGenerator::presearch()
         }
     }
 
+    if (searchtype == SEARCH_TEXT)
+    {
+        // text seeds are the sign-extended 32-bit hashes, ordered by the
+        // unsigned hash, so that their lower bits are those of the 48-bit seed
+        uint32_t h0 = sstart == (int32_t) sstart ? (uint32_t) sstart : 0;
+        if (!slist.empty())
+        {   // the 48-bit candidates that are also text seeds
+            std::vector<int64_t> tlist;
+            for (int64_t s48 : slist)
+            {
+                int64_t s = (int32_t)(uint32_t) s48;
+                if ((s & MASK48) == (s48 & MASK48))
+                    tlist.push_back(s);
+            }
+            std::sort(tlist.begin(), tlist.end(), [](int64_t a, int64_t b) {
+                return (uint32_t) a < (uint32_t) b;
+            });
+            slist.swap(tlist);
+            scnt = slist.size();
+            for (idx = 0; idx < scnt; idx++)
+                if ((uint32_t) slist[idx] >= h0)
+                    break;
+            if (idx >= scnt)
+                isdone = true;
+            else
+                seed = slist[idx];
+        }
+        else
+        {
+            scnt = (uint64_t)1 << 32;
+            seed = (int32_t) h0;
+            int bits;
+            std::vector<uint32_t> res;
+            std::vector<int64_t> extra;
+            if (getLow48Residues(cond, ccnt, mc, &bits, &res, &extra))
+            {
+                lowok.assign((size_t)1 << bits, 0);
+                for (uint32_t r : res)
+                    lowok[r] = 1;
+                // the extra seeds that are text seeds, by their hash
+                for (int64_t s : extra)
+                    if (s < ((int64_t)1 << 31) || s >= ((int64_t)1 << 48) - ((int64_t)1 << 31))
+                        lowextra.push_back((uint32_t) s);
+                std::sort(lowextra.begin(), lowextra.end());
+            }
+        }
+    }
+
     if (searchtype == SEARCH_BLOCKS)
     {
         if (!slist.empty())
@@ -343,6 +987,10 @@ void SearchItemGenerator::presearch()
         {
             scnt = ~(uint64_t)0;
             seed = sstart;
+            int64_t low = sstart & MASK48;
+            if (low < MASK48)
+                scan48.start(mc, cond, ccnt, low + 1, threads, abort,
+                             merge48.empty() ? NULL : &merge48);
         }
     }
 }
@@ -362,6 +1010,14 @@ void SearchItemGenerator::getProgress(uint64_t *prog, uint64_t *end)
             *prog = (uint64_t) seed;
     }
 
+    if (searchtype == SEARCH_TEXT)
+    {
+        if (!slist.empty())
+            *prog = idx;
+        else
+            *prog = (uint32_t) seed;
+    }
+
     if (searchtype == SEARCH_BLOCKS)
     {
         if (!slist.empty())
@@ -374,50 +1030,568 @@ void SearchItemGenerator::getProgress(uint64_t *prog, uint64_t *end)
 }
 
 
-// does the 48-bit seed meet the conditions c..ce?
-static bool isCandidate(int64_t s48, int mc, const Condition *c, const Condition *ce, std::atomic_bool *abort)
+bool SearchItemGenerator::sampleSeed(std::mt19937_64& rng, int64_t *seed)
+{
+    if (isdone)
+        return false;
+    int64_t high = rng() & 0xffff;
+    if (searchtype == SEARCH_LIST || (searchtype == SEARCH_TEXT && !slist.empty()))
+    {
+        if (slist.empty())
+            return false;
+        *seed = slist[rng() % slist.size()];
+    }
+    else if (!slist.empty())
+    {   // 48-bit list for an incremental or block search
+        *seed = (high << 48) | slist[rng() % slist.size()];
+    }
+    else if (searchtype == SEARCH_TEXT)
+    {
+        *seed = (int32_t) rng();
+    }
+    else
+    {
+        *seed = (int64_t) rng();
+    }
+    return true;
+}
+
+
+// Adjusts the automatic item size toward the target duration, based on the
+// timings of the last 'autowin' items (i.e. once per reorder window).
+void SearchItemGenerator::adaptItemSize(int64_t cnt, int64_t nsec)
+{
+    if (!autosize || cnt <= 0)
+        return;
+    autoseeds += cnt;
+    autonsec += nsec;
+    if (++autocnt < autowin)
+        return;
+
+    double nsecPerSeed = (double) autonsec / autoseeds;
+    if (nsecPerSeed < 1)
+        nsecPerSeed = 1;
+    double siz = ITEM_TARGET_NSEC / nsecPerSeed;
+    // grow gradually, but shrink immediately to keep the latency low
+    if (siz > 4.0 * itemsiz)
+        siz = 4.0 * itemsiz;
+    int maxsiz = searchtype == SEARCH_BLOCKS ? 0x10000 : ITEM_AUTO_MAX;
+    if (siz > maxsiz)
+        siz = maxsiz;
+    if (siz < 1)
+        siz = 1;
+    itemsiz = (int) siz;
+
+    autocnt = 0;
+    autoseeds = 0;
+    autonsec = 0;
+}
+
+
+// does the 48-bit seed meet the compiled conditions c..ce?
+static bool isCandidate(StructPos *spos, int64_t s48, const CompiledCond *c, const CompiledCond *ce, std::atomic_bool *abort)
 {
-    StructPos spos[100] = {};
     for (; c != ce; c++)
-        if (!testCond(spos, s48, c, mc, NULL, abort))
+        if (!testCompiled(c, spos, s48, NULL, abort))
             return false;
     return true;
 }
 
-SearchItem *SearchItemGenerator::requestItem()
+
+struct Filter48Worker : public QRunnable
 {
-    if (isdone)
-        return NULL;
+    Filter48Worker(SearchItemGenerator *gen, int64_t first, int64_t end, char *keep, StructPos *sp48)
+        : gen(gen),first(first),end(end),keep(keep),sp48(sp48) {}
+    void run() override { gen->filterRange48(first, end, keep, sp48); }
+    SearchItemGenerator *gen;
+    int64_t first, end;
+    char *keep;
+    StructPos *sp48;
+};
+
+// The 48-bit conditions of an incremental search over a 48-bit list only
+// depend on the list entry, so rather than testing them for each of the
+// 65536 upper bits, the list is reduced to the entries that pass them. The
+// positions that the other conditions are relative to are kept for each entry.
+void SearchItemGenerator::filter48()
+{
+    // the query tails, and the version copies of splitVersions(), are tested
+    // per seed, including their 48-bit conditions, but they can also refer to
+    // a shared one
+    for (int i = 0; i < ccnt + tcnt; i++)
+    {
+        const Condition& c = cond[i];
+        if ((i < ccnt && prog[i].s48) || !c.relative)
+            continue;
+        for (int j = 0; j < ccnt; j++)
+        {
+            if (cond[j].save == c.relative && prog[j].s48 &&
+                std::find(save48.begin(), save48.end(), c.relative) == save48.end())
+                save48.push_back(c.relative);
+        }
+    }
+
+    int64_t len = slist.size();
+    size_t n48 = save48.size();
+    std::vector<char> keep(len);
+    std::vector<StructPos> sp48(len * n48);
+
+    int nthreads = threads < 1 ? 1 : threads;
+    QThreadPool filterpool;
+    filterpool.setMaxThreadCount(nthreads);
+    int64_t chunk = (len + 4 * nthreads - 1) / (4 * nthreads);
+    if (chunk < 1024)
+        chunk = 1024;
+    for (int64_t i = 0; i < len; i += chunk)
+    {
+        int64_t e = i + chunk < len ? i + chunk : len;
+        filterpool.start(new Filter48Worker(this, i, e, keep.data(), sp48.data()));
+    }
+    filterpool.waitForDone();
+
+    if (*abort)
+    {   // the items will test the 48-bit conditions themselves
+        save48.clear();
+        return;
+    }
+
+    size_t n = 0;
+    for (int64_t i = 0; i < len; i++)
+    {
+        if (!keep[i])
+            continue;
+        slist[n] = slist[i];
+        std::copy(sp48.begin() + i * n48, sp48.begin() + (i+1) * n48, sp48.begin() + n * n48);
+        n++;
+    }
+    slist.resize(n);
+    sp48.resize(n * n48);
+    spos48.swap(sp48);
+    filtered48 = true;
+}
+
+void SearchItemGenerator::filterRange48(int64_t first, int64_t end, char *keep, StructPos *sp48)
+{
+    StructPos *spos = getSearchContext().spos;
+    size_t n48 = save48.size();
+    for (int64_t i = first; i < end && !*abort; i++)
+    {
+        keep[i] = isCandidate(spos, slist[i], prog.data(), prog.data()+ccnt, abort);
+        if (keep[i])
+            for (size_t j = 0; j < n48; j++)
+            sp48[i * n48 + j] = spos[save48[j]];
+    }
+}
+
+
+struct Scan48Worker : public QRunnable
+{
+    Scan48Worker(Candidate48Scanner *scanner) : scanner(scanner) {}
+    void run() override { scanner->scan(); }
+    Candidate48Scanner *scanner;
+};
+
+void Candidate48Scanner::start(int mc, const Condition *cond, int ccnt, int64_t low,
+                               int threads, std::atomic_bool *abort, CandidateMerge *merge)
+{
+    stop();
+    if (threads < 1)
+        threads = 1;
+
+    this->mc = mc;
+    this->cond = cond;
+    this->ccnt = ccnt;
+    this->abort = abort;
+    this->merge = merge;
+    compileConditions(cond, ccnt, mc, &prog);
+    mergeend = false;
+    if (merge)
+        merge->seek(low);
+    // structure conditions with a small area only allow some lower bits
+    if (!getLow48Residues(cond, ccnt, mc, &lowbits, &lowres, &lowextra))
+    {
+        lowres.clear();
+        lowextra.clear();
+    }
+    base = low;
+    nextchunk = 0;
+    curchunk = 0;
+    curidx = 0;
+    chunks.clear();
+    chunks.resize(threads * CHUNKS_PER_THREAD);
+    stopped = false;
+
+    pool.setMaxThreadCount(threads);
+    for (int i = 0; i < threads; i++)
+        pool.start(new Scan48Worker(this));
+}
+
+void Candidate48Scanner::stop()
+{
+    mutex.lock();
+    stopped = true;
+    avail.wakeAll();
+    space.wakeAll();
+    mutex.unlock();
+    pool.waitForDone();
+}
+
+void Candidate48Scanner::scan()
+{
+    StructPos *spos = getSearchContext().spos;
+    std::vector<int64_t> cands;
+
+    mutex.lock();
+    while (!stopped)
+    {
+        if (nextchunk >= curchunk + chunks.size())
+        {   // too far ahead of the consumer
+            space.wait(&mutex);
+            continue;
+        }
+        uint64_t n = nextchunk;
+        int64_t s = base + (int64_t)n * CHUNK_SIZE;
+        if (merge ? mergeend : s > MASK48)
+            break;
+        nextchunk++;
+
+        cands.clear();
+        if (merge)
+        {   // pull the next merged candidates and filter them in place
+            int64_t s48;
+            while (cands.size() < MERGE_CHUNK && merge->next(&s48))
+                cands.push_back(s48);
+            mergeend = cands.size() < MERGE_CHUNK;
+            bool last = mergeend;
+            mutex.unlock();
+
+            size_t k = 0;
+            for (size_t i = 0; i < cands.size() && !*abort; i++)
+            {
+                if (isCandidate(spos, cands[i], prog.data(), prog.data()+ccnt, abort))
+                    cands[k++] = cands[i];
+            }
+            cands.resize(k);
+
+            mutex.lock();
+            Chunk& chunk = chunks[n % chunks.size()];
+            chunk.cands.swap(cands);
+            chunk.done = true;
+            chunk.last = last;
+            avail.wakeAll();
+            continue;
+        }
+        mutex.unlock();
+
+        int64_t e = s + CHUNK_SIZE - 1;
+        if (e > MASK48)
+            e = MASK48;
+        if (lowres.empty())
+        {
+            for (; s <= e && !*abort; s++)
+            {
+                if (isCandidate(spos, s, prog.data(), prog.data()+ccnt, abort))
+                    cands.push_back(s);
+            }
+        }
+        else
+        {   // only visit the seeds with suitable lower bits
+            int64_t m = ((int64_t)1 << lowbits) - 1;
+            for (int64_t p = s & ~m; p <= e && !*abort; p += m + 1)
+            {
+                auto it = std::lower_bound(lowres.begin(), lowres.end(), (uint32_t)(s > p ? s - p : 0));
+                for (; it != lowres.end() && p + *it <= e; ++it)
+                {
+                    if (isCandidate(spos, p + *it, prog.data(), prog.data()+ccnt, abort))
+                        cands.push_back(p + *it);
+                }
+            }
+            // and the few seeds that meet the conditions with other lower bits
+            size_t mid = cands.size();
+            auto it = std::lower_bound(lowextra.begin(), lowextra.end(), s);
+            for (; it != lowextra.end() && *it <= e && !*abort; ++it)
+            {
+                if (isCandidate(spos, *it, prog.data(), prog.data()+ccnt, abort))
+                    cands.push_back(*it);
+            }
+            std::inplace_merge(cands.begin(), cands.begin() + mid, cands.end());
+        }
+
+        mutex.lock();
+        Chunk& chunk = chunks[n % chunks.size()];
+        chunk.cands.swap(cands);
+        chunk.done = true;
+        avail.wakeAll();
+    }
+    mutex.unlock();
+}
+
+bool Candidate48Scanner::next(int64_t *s48)
+{
+    QMutexLocker locker(&mutex);
+    while (!stopped && !*abort)
+    {
+        if (!merge && base + (int64_t)curchunk * CHUNK_SIZE > MASK48)
+            return false;
+
+        Chunk& chunk = chunks[curchunk % chunks.size()];
+        if (!chunk.done)
+        {
+            avail.wait(&mutex, 100);
+            continue;
+        }
+        if (curidx < chunk.cands.size())
+        {
+            *s48 = chunk.cands[curidx++];
+            return true;
+        }
+        if (chunk.last)
+            return false;
+        chunk.done = false;
+        chunk.cands.clear();
+        curchunk++;
+        curidx = 0;
+        space.wakeAll();
+    }
+    return false;
+}
+
+uint64_t SearchItemGenerator::getPos()
+{
+    int64_t high = (seed >> 48) & 0xffff;
+
+    if (searchtype == SEARCH_LIST)
+        return idx;
+    if (searchtype == SEARCH_INC)
+        return slist.empty() ? (uint64_t) seed : high * slist.size() + idx;
+    if (searchtype == SEARCH_TEXT)
+        return slist.empty() ? (uint64_t)(uint32_t) seed : idx;
+    if (searchtype == SEARCH_BLOCKS)
+    {
+        uint64_t low = slist.empty() ? (uint64_t)(seed & MASK48) : idx;
+        return (low << 16) | high;
+    }
+    return 0;
+}
+
+void SearchItemGenerator::setPos(uint64_t pos)
+{
+    if (searchtype == SEARCH_LIST)
+    {
+        idx = pos;
+        if (idx >= scnt)
+            isdone = true;
+        else
+            seed = slist[idx];
+    }
+
+    if (searchtype == SEARCH_INC)
+    {
+        if (!slist.empty())
+        {
+            uint64_t high = pos / slist.size();
+            idx = pos % slist.size();
+            if (high >= 0x10000)
+                isdone = true;
+            else
+                seed = (high << 48) | slist[idx];
+        }
+        else
+        {
+            seed = (int64_t) pos;
+        }
+    }
+
+    if (searchtype == SEARCH_TEXT)
+    {
+        if (!slist.empty())
+        {
+            idx = pos;
+            if (idx >= scnt)
+                isdone = true;
+            else
+                seed = slist[idx];
+        }
+        else
+        {
+            if (pos >= scnt)
+                isdone = true;
+            else
+                seed = (int32_t)(uint32_t) pos;
+        }
+    }
+    if (searchtype == SEARCH_BLOCKS)
+    {
+        int64_t high = pos & 0xffff;
+        uint64_t low = pos >> 16;
+        if (!slist.empty())
+        {
+            idx = low;
+            if (idx >= slist.size())
+                isdone = true;
+            else
+                seed = (high << 48) | slist[idx];
+        }
+        else
+        {
+            // advance to the first candidate at or after the position
+            int64_t s48 = seed & MASK48;
+            while (s48 < (int64_t) low)
+            {
+                if (!scan48.next(&s48))
+                {
+                    isdone = !*abort;
+                    return;
+                }
+            }
+            if (s48 > (int64_t) low)
+                high = 0;
+            seed = (high << 48) | s48;
+        }
+    }
+}
 
+// Skips the ranges that are already done and limits the number of seeds 'n'
+// for the next item so that it ends before the next done range.
+bool SearchItemGenerator::skipDone(uint64_t *n)
+{
+    uint64_t pos = getPos();
+    while (true)
+    {
+        auto it = done.upper_bound(pos);
+        if (it != done.begin() && std::prev(it)->second >= pos)
+        {
+            uint64_t last = std::prev(it)->second;
+            if (last == ~(uint64_t)0)
+                isdone = true;
+            else
+                setPos(last + 1);
+            if (isdone || *abort)
+                return false;
+            pos = getPos();
+            continue;
+        }
+        if (it != done.end() && it->first - pos < *n)
+            *n = it->first - pos;
+        return true;
+    }
+}
+
+SearchItem *SearchItemGenerator::newItem(int64_t sstart, int64_t idx, uint64_t pos, int64_t n)
+{
     SearchItem *item = new SearchItem();
 
     item->searchtype = searchtype;
     item->mc        = mc;
     item->cond      = cond;
+    item->prog      = prog.data();
     item->ccnt      = ccnt;
+    item->tcnt      = tcnt;
+    item->qmask     = qmask.data();
+    item->tmc       = tmc.empty() ? NULL : tmc.data();
+    item->qall      = ~(uint32_t)0 >> (32 - qcnt);
+    item->multiq    = qcnt > 1;
     item->itemid    = itemid++;
     item->slist     = slist.empty() ? NULL : slist.data();
     item->len       = slist.size();
     item->idx       = idx;
-    item->sstart    = seed;
-    item->scnt      = itemsiz;
-    item->seed      = seed;
-    item->isdone    = isdone;
+    item->sstart    = sstart;
+    item->pos       = pos;
+    item->seed      = sstart;
+    item->isdone    = false;
     item->abort     = abort;
+    item->queue     = NULL;
+    item->order48   = order48;
+    item->orderfull = orderfull;
+    item->timing    = timing || profile;
+    item->profile   = profile;
+    item->profcnt   = 0;
+    item->stats.resize(2 * ccnt);
+    if (profile)
+        item->planstats.resize(2 * ccnt);
+    item->s48done   = filtered48;
+    item->spos48    = spos48.empty() ? NULL : spos48.data();
+    item->save48    = save48.data();
+    item->n48       = filtered48 ? save48.size() : 0;
+    item->blockcond = blockcond.data();
+    item->useblockpos = false;
+    item->biomeplan = biomeplan.groups.empty() ? NULL : &biomeplan;
+    item->lowok     = lowok.empty() ? NULL : lowok.data();
+    item->lowmask   = lowok.size() - 1;
+    item->lowextra  = lowextra.data();
+    item->nlowextra = lowextra.size();
+
+    item->range = new ItemRange();
+    item->range->span = (uint64_t) n << 32;
+    item->range->seed = sstart;
+    item->range->pos = pos;
+    item->range->sstart = sstart;
+    item->range->idx = idx;
+
+    return item;
+}
+
+SearchItem *SearchItemGenerator::requestItem()
+{
+    if (isdone)
+        return NULL;
+
+    uint64_t n = itemsiz;
+    if (!done.empty() && !skipDone(&n))
+        return NULL;
+
+    // the item range should end at the end of the search space (or block)
+    int64_t high = (seed >> 48) & 0xffff;
+    if (searchtype == SEARCH_LIST)
+    {
+        if (idx >= scnt)
+        {
+            isdone = true;
+            return NULL;
+        }
+        if (idx + n > scnt)
+            n = scnt - idx;
+    }
+    if (searchtype == SEARCH_INC)
+    {
+        if (!slist.empty())
+        {
+            uint64_t rem = (0x10000 - high) * slist.size() - idx;
+            if (n > rem)
+                n = rem;
+        }
+        else
+        {
+            if (~(uint64_t)seed < n - 1)
+                n = ~(uint64_t)seed + 1;
+        }
+    }
+    if (searchtype == SEARCH_TEXT)
+    {
+        uint64_t rem = scnt - getPos();
+        if (n > rem)
+            n = rem;
+    }
+    if (searchtype == SEARCH_BLOCKS)
+    {
+        if (n > (uint64_t)(0x10000 - high))
+            n = 0x10000 - high;
+    }
+
+    SearchItem *item = newItem(seed, idx, getPos(), n);
 
     if (searchtype == SEARCH_LIST)
     {
-        if (idx + itemsiz > scnt)
-            item->scnt = scnt - idx;
-        idx += itemsiz;
+        idx += n;
+        if (idx >= scnt)
+            isdone = true;
     }
 
     if (searchtype == SEARCH_INC)
     {
         if (!slist.empty())
         {
-            int64_t high = (seed >> 48) & 0xffff;
-            idx += itemsiz;
+            idx += n;
             high += idx / slist.size();
             idx %= slist.size();
             seed = (high << 48) | slist[idx];
@@ -427,18 +1601,31 @@ SearchItem *SearchItemGenerator::requestItem()
         else
         {
             unsigned long long int s;
-            if (__builtin_uaddll_overflow(seed, itemsiz, &s))
+            if (__builtin_uaddll_overflow(seed, n, &s))
                 isdone = true;
             seed = (int64_t)s;
         }
     }
 
+    if (searchtype == SEARCH_TEXT)
+    {
+        uint64_t pos = getPos() + n;
+        if (pos >= scnt)
+            isdone = true;
+        else if (!slist.empty())
+        {
+            idx = pos;
+            seed = slist[idx];
+        }
+        else
+            seed = (int32_t)(uint32_t) pos;
+    }
+
     if (searchtype == SEARCH_BLOCKS)
     {
         if (!slist.empty())
         {
-            int64_t high = (seed >> 48) & 0xffff;
-            high += itemsiz;
+            high += n;
             if (high >= 0x10000)
             {
                 high = 0;
@@ -451,22 +1638,14 @@ SearchItem *SearchItemGenerator::requestItem()
         }
         else
         {
-            int64_t high = (seed >> 48) & 0xffff;
             int64_t low = seed & MASK48;
-            high += itemsiz;
+            high += n;
             if (high >= 0x10000)
             {
-                item->scnt -= 0x10000 - high;
                 high = 0;
-                low++;
 
-                /// === search for next candidate ===
-                for (; low <= MASK48; low++)
-                {
-                    if (isCandidate(low, mc, cond, cond+ccnt, abort))
-                        break;
-                }
-                if (low > MASK48)
+                /// === next candidate from the scanners ===
+                if (!scan48.next(&low) && !*abort)
                     isdone = true;
             }
             seed = (high << 48) | low;
@@ -476,3 +1655,107 @@ SearchItem *SearchItemGenerator::requestItem()
     return item;
 }
 
+// Orders the conditions of each pass by increasing cost per rejected seed,
+// c / (1 - p), which minimizes the expected cost per seed for independent
+// conditions. A condition stays behind the one it is positioned relative to.
+// Returns a description of the order.
+QString SearchItemGenerator::planOrder(const QVector<CondStat>& stats)
+{
+    QString desc;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        QVector<int>& order = pass == 0 ? order48 : orderfull;
+        const CondStat *st = stats.constData() + pass * ccnt;
+
+        bool sampled = true;
+        for (int i : order)
+            sampled &= st[i].calls >= PLAN_MIN_CALLS;
+
+        if (sampled)
+        {
+            QVector<double> rank(ccnt);
+            for (int i : order)
+            {
+                double c = (double) st[i].nsec / st[i].timed;
+                double q = 1.0 - (double) st[i].passed / st[i].calls;
+                rank[i] = q > 0 ? c / q : HUGE_VAL;
+            }
+            QVector<int> todo = order;
+            order.clear();
+            while (!todo.empty())
+            {
+                int best = -1;
+                for (int j = 0; j < todo.size(); j++)
+                {
+                    const Condition& c = cond[todo[j]];
+                    bool ready = true;
+                    if (c.relative)
+                        for (int k : todo)
+                            ready &= cond[k].save != c.relative;
+                    if (ready && (best < 0 || rank[todo[j]] < rank[todo[best]]))
+                        best = j;
+                }
+                order.push_back(todo[best]);
+                todo.remove(best);
+            }
+        }
+
+        desc += pass == 0 ? "48-bit:" : "; full:";
+        for (int i = 0; i < order.size(); i++)
+            desc += QString::asprintf(i ? " > [%02d]" : " [%02d]", cond[order[i]].save);
+    }
+    return desc;
+}
+
+// Splits the second half of the remaining seeds off an active item.
+SearchItem *SearchItemGenerator::splitItem(ItemRange *range, int64_t minsize)
+{
+    int64_t first, end;
+    if (!range->split(minsize, &first, &end))
+        return NULL;
+
+    int64_t sstart = range->sstart;
+    int64_t idx = range->idx;
+    int64_t high = (sstart >> 48) & 0xffff;
+
+    if (searchtype == SEARCH_LIST)
+    {
+        idx += first;
+        sstart = slist[idx];
+    }
+    if (searchtype == SEARCH_INC)
+    {
+        if (!slist.empty())
+        {
+            idx += first;
+            high += idx / slist.size();
+            idx %= slist.size();
+            sstart = (high << 48) | slist[idx];
+        }
+        else
+        {
+            sstart += first;
+        }
+    }
+    if (searchtype == SEARCH_TEXT)
+    {
+        if (!slist.empty())
+        {
+            idx += first;
+            sstart = slist[idx];
+        }
+        else
+        {
+            sstart = (int32_t)((uint32_t) sstart + (uint32_t) first);
+        }
+    }
+
+    if (searchtype == SEARCH_BLOCKS)
+    {
+        high += first;
+        sstart = (high << 48) | (sstart & MASK48);
+    }
+
+    return newItem(sstart, idx, range->pos + first, end - first);
+}
+
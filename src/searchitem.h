@@ -7,17 +7,147 @@
 #include <QMutex>
 #include <QVector>
 #include <QElapsedTimer>
+#include <QSemaphore>
+#include <QWaitCondition>
+#include <QStringList>
 
 #include "settings.h"
 #include "search.h"
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <random>
 
-struct SearchItem : public QObject, QRunnable
+
+// Remaining range of a search item. It is owned by the search controller and
+// outlives the item, so that the rest of a slow item can be split off for idle
+// workers, and so that the controller can tell up to where the search is safe
+// to resume.
+struct ItemRange
 {
-    Q_OBJECT
-public:
+    ItemRange() : span(),seed(),pos(),sstart(),idx(),canceled() {}
+
+    // claims the next index of the range for processing
+    bool claim()
+    {
+        uint64_t s = span.load(std::memory_order_relaxed);
+        do
+        {
+            if ((s & 0xffffffff) >= (s >> 32))
+                return false;
+        }
+        while (!span.compare_exchange_weak(s, s + 1, std::memory_order_relaxed));
+        return true;
+    }
+
+    // shortens the range to the first half of what remains and returns the
+    // second half as [*first, *end)
+    bool split(int64_t minsize, int64_t *first, int64_t *end)
+    {
+        uint64_t s = span.load(std::memory_order_relaxed);
+        uint64_t cur, mid;
+        do
+        {
+            cur = s & 0xffffffff;
+            *end = s >> 32;
+            if (*end - (int64_t)cur < 2 * minsize)
+                return false;
+            mid = cur + (*end - cur) / 2;
+        }
+        while (!span.compare_exchange_weak(s, (mid << 32) | cur, std::memory_order_relaxed));
+        *first = mid;
+        return true;
+    }
 
-    SearchItem() : QObject(),QRunnable()
+    int64_t remaining() const
+    {
+        uint64_t s = span.load(std::memory_order_relaxed);
+        return (int64_t)(s >> 32) - (int64_t)(s & 0xffffffff);
+    }
+
+    std::atomic<uint64_t>   span;       // (end << 32) | next index
+    std::atomic<int64_t>    seed;       // seed in progress (nothing before is pending)
+    uint64_t                pos;        // search space position of the first seed
+    int64_t                 sstart;     // first seed
+    int64_t                 idx;        // first index in the candidate list
+    bool                    canceled;   // the item was discarded (range stays pending)
+};
+
+// Evaluation counters of a condition. The time is only measured for a
+// sample of the calls, which is counted separately.
+struct CondStat
+{
+    uint64_t            calls;
+    uint64_t            passed;
+    uint64_t            timed;      // number of calls that were timed
+    uint64_t            nsec;       // duration of the timed calls in nanoseconds
+};
+
+// Completion record of a search item, handed from the worker to the search
+// controller.
+struct ItemResult
+{
+    ItemResult        * next;
+    ItemRange         * range;
+    uint64_t            itemid;
+    bool                isdone;     // the final seed was reached
+    bool                canceled;   // the item was discarded without running
+    uint64_t            pos;        // search space position of the first seed
+    int64_t             cnt;        // number of seeds tested
+    int64_t             nsec;       // processing time
+    QVector<int64_t>    matches;
+    QVector<uint32_t>   matchq;     // queries of each match (multi-query search)
+    QVector<CondStat>   stats;      // condition counters
+    QVector<CondStat>   planstats;  // complete evaluations for the planner (when profiling)
+};
+
+// Lock-free multi-producer, single-consumer queue for item results. Workers
+// push onto an atomic stack, and the controller takes the entire stack in one
+// exchange, restoring the order of completion.
+struct ResultQueue
+{
+    ResultQueue() : head(NULL), wake() {}
+
+    void push(ItemResult *r)
+    {
+        r->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(r->next, r,
+                std::memory_order_release, std::memory_order_relaxed))
+            ;
+        wake.release();
+    }
+
+    // returns the queued results (oldest first) as a linked list
+    ItemResult *takeAll()
+    {
+        ItemResult *r = head.exchange(NULL, std::memory_order_acquire);
+        ItemResult *prev = NULL;
+        while (r)
+        {
+            ItemResult *next = r->next;
+            r->next = prev;
+            prev = r;
+            r = next;
+        }
+        return prev;
+    }
+
+    // blocks until something was pushed or the timeout expires
+    void wait(int msec)
+    {
+        if (wake.tryAcquire(1, msec))
+            wake.tryAcquire(wake.available());
+    }
+
+    std::atomic<ItemResult*>    head;
+    QSemaphore                  wake;
+};
+
+
+struct SearchItem : public QRunnable
+{
+    SearchItem() : QRunnable()
     {
         setAutoDelete(true);
     }
@@ -27,67 +157,271 @@ public:
 
     inline bool testSeed(StructPos *spos, int64_t seed, LayerStack *g, bool s48check)
     {
-        const Condition *c, *ce = cond + ccnt;
+        const int *o, *oe;
+        if (!timing)
+        {
+            if (s48check)
+            {
+                for (o = order48.constData(), oe = o + order48.size(); o != oe; o++)
+                    if (!testCompiled(prog + *o, spos, seed, NULL, abort))
+                        return false;
+            }
+            for (o = orderfull.constData(), oe = o + orderfull.size(); o != oe; o++)
+                if (!testFullCond(spos, seed, *o, g))
+                    return false;
+            return true;
+        }
+
+        if ((++profcnt % PROFILE_STRIDE) == 0)
+            return timeSeed(spos, seed, g, s48check);
+
+        CondStat *st = stats.data();
         if (s48check)
         {
-            for (c = cond; c != ce; c++)
-                if (!testCond(spos, seed, c, mc, NULL, abort))
+            for (o = order48.constData(), oe = o + order48.size(); o != oe; o++)
+            {
+                st[*o].calls++;
+                if (!testCompiled(prog + *o, spos, seed, NULL, abort))
                     return false;
+                st[*o].passed++;
+            }
         }
-        for (c = cond; c != ce; c++)
+        st += ccnt;
+        for (o = orderfull.constData(), oe = o + orderfull.size(); o != oe; o++)
         {
-            if (g_filterinfo.list[c->type].cat == CAT_48)
-                continue;
-            if (!testCond(spos, seed, c, mc, g, abort))
+            st[*o].calls++;
+            if (!testFullCond(spos, seed, *o, g))
                return false;
+            st[*o].passed++;
         }
         return true;
     }
 
-signals:
-    int results(QVector<int64_t> seeds, bool countonly);
-    void itemDone(uint64_t itemid, int64_t seed, bool isdone);
-    void canceled(uint64_t itemid);
+    inline int testFullCond(StructPos *spos, int64_t seed, int i, LayerStack *g)
+    {
+        if (useblockpos && blockcond[i])
+        {
+            const std::vector<Pos>& p = blockpos[i];
+            return testCondPositions(spos, seed, cond + i, mc, g, p.data(), p.size(), abort);
+        }
+        return testCompiled(prog + i, spos, seed, g, abort);
+    }
+
+    // tests the conditions that are not shared by all queries, for a seed
+    // that passed the shared ones, and returns the matching queries of 'alive'
+    inline uint32_t testQueries(StructPos *spos, int64_t seed, LayerStack *g, uint32_t alive, bool s48check)
+    {
+        if (tcnt == 0)
+            return alive;
+        return testQueryConds(spos, seed, g, alive, s48check);
+    }
+    uint32_t testQueryConds(StructPos *spos, int64_t seed, LayerStack *g, uint32_t alive, bool s48check);
+
+    // looks up the generators of the further conditions in the thread of the
+    // item (version search)
+    void setupGenerators(SearchContext& ctx)
+    {
+        tgen.clear();
+        for (int i = 0; tmc && i < tcnt; i++)
+            tgen.push_back(ctx.getGenerator(tmc[i]));
+    }
+
+    // whether the lower bits of a text seed allow a match
+    inline bool isLowOk(uint32_t h) const
+    {
+        return !lowok || lowok[h & lowmask] || std::binary_search(lowextra, lowextra + nlowextra, h);
+    }
+
+    // tests a seed like testSeed() while timing the conditions, for every
+    // PROFILE_STRIDE-th seed
+    bool timeSeed(StructPos *spos, int64_t seed, LayerStack *g, bool s48check);
+    // evaluates all conditions (of a pass) while recording their statistics
+    bool profileSeed(StructPos *spos, int64_t seed, LayerStack *g, bool s48check);
+
+    enum { PROFILE_STRIDE = 16 };
 
 public:
     int                 searchtype;
     int                 mc;
     const Condition   * cond;
-    int                 ccnt;
+    const CompiledCond *prog;       // compiled conditions
+    int                 ccnt;       // number of conditions shared by all queries
+    int                 tcnt;       // number of further conditions, following the shared ones
+    const uint32_t    * qmask;      // queries of each further condition
+    const int         * tmc;        // version of each further condition (version search)
+    std::vector<LayerStack*> tgen;  // generators of these versions
+    uint32_t            qall;       // mask of all queries
+    bool                multiq;     // report the queries of the matches
     uint64_t            itemid;     // item identifier
     const int64_t     * slist;      // candidate list
     int64_t             len;        // number of candidates
     int64_t             idx;        // current index in candidate buffer
     int64_t             sstart;     // starting seed
-    int                 scnt;       // number of seeds to process in this item
+    uint64_t            pos;        // search space position of the starting seed
+    ItemRange         * range;      // seeds to process in this item
     int64_t             seed;       // (out) current seed while processing
     bool                isdone;     // (out) has the final seed been reached
     std::atomic_bool  * abort;
+    ResultQueue       * queue;      // destination for the item result
+    QVector<int>        order48;    // evaluation order of the conditions with a 48-bit seed
+    QVector<int>        orderfull;  // evaluation order of the non-48-bit conditions
+    bool                timing;     // count the conditions and time a sample of them
+    bool                profile;    // sample complete evaluations for the planner
+    int                 profcnt;
+    QVector<CondStat>   stats;      // (out) [0,ccnt): 48-bit pass, [ccnt,2*ccnt): full pass
+    QVector<CondStat>   planstats;  // (out) same layout, for the planner
+    bool                s48done;    // the list entries already passed the 48-bit conditions
+    const StructPos   * spos48;     // positions of the 48-bit conditions per list entry
+    const int         * save48;     // condition IDs of these positions
+    int                 n48;
+    const char        * blockcond;  // conditions with positions that are listed once per block
+    bool                useblockpos;
+    std::vector<std::vector<Pos>> blockpos; // in-area positions of these conditions for the current block
+    const BiomePlan   * biomeplan;  // biome conditions that share their generated area
+    const char        * lowok;      // lower bits of the seeds worth testing (text search, optional)
+    uint32_t            lowmask;
+    const uint32_t    * lowextra;   // hashes of the seeds worth testing with other lower bits
+    size_t              nlowextra;
 
     // the end seed is highest unsigned seed value in the search space
     // (or the last entry in the seed list)
 };
 
 
+// Streams the quad bases moved to each region offset of the gen48 area in
+// increasing order, without materializing the combined list. Each offset adds
+// a constant to the sorted bases, which gives a rotated sorted stream, and the
+// streams are merged with a heap (dropping duplicates).
+struct CandidateMerge
+{
+    CandidateMerge() : bases(),streams(),heap(),last(-1) {}
+
+    // 'bases' must be 48-bit, sorted and unique
+    void init(const std::vector<int64_t>& bases, int x, int z, int w, int h);
+    bool empty() const { return streams.empty(); }
+    // continue at the first candidate >= low
+    void seek(int64_t low);
+    // the next candidate, false once all are done
+    bool next(int64_t *s48);
+
+    struct Stream
+    {
+        int64_t off;        // added to the bases (modulo 2^48)
+        size_t start;       // index of the smallest moved base
+        size_t pos;         // position in the stream
+    };
+    int64_t value(const Stream& st) const
+    {
+        return (bases[(st.start + st.pos) % bases.size()] + st.off) & MASK48;
+    }
+
+    std::vector<int64_t>    bases;
+    std::vector<Stream>     streams;
+    std::vector<std::pair<int64_t, int>> heap; // min-heap of (value, stream)
+    int64_t                 last;       // last emitted candidate
+};
+
+// Finds the 48-bit candidates of a block search in parallel, for when no
+// candidate list is available. The scanners work on consecutive chunks of the
+// 48-bit range, up to a limited number of chunks ahead of the consumer, and the
+// candidates are handed out in increasing order.
+struct Candidate48Scanner
+{
+    enum { CHUNK_SIZE = 0x40000, MERGE_CHUNK = 0x1000, CHUNKS_PER_THREAD = 4 };
+
+    struct Chunk
+    {
+        bool done;
+        bool last;          // no chunks follow (from a merge)
+        std::vector<int64_t> cands;
+    };
+
+    Candidate48Scanner() : prog(),merge(),lowbits(),lowres(),lowextra(),mutex(),avail(),space(),pool(),chunks(),stopped(true) {}
+    ~Candidate48Scanner() { stop(); }
+
+    // start scanning at 'low' with the 48-bit conditions in cond[0..ccnt),
+    // either over all seeds or over the seeds of a merge
+    void start(int mc, const Condition *cond, int ccnt, int64_t low,
+               int threads, std::atomic_bool *abort, CandidateMerge *merge = NULL);
+    void stop();
+
+    // blocks until the next candidate is available, returns false when the
+    // range was exhausted or the scan was stopped
+    bool next(int64_t *s48);
+
+    void scan(); // worker loop
+
+    int                     mc;
+    const Condition       * cond;
+    int                     ccnt;
+    std::vector<CompiledCond> prog;     // compiled conditions
+    std::atomic_bool      * abort;
+    CandidateMerge        * merge;      // source of the seeds to test (optional)
+    bool                    mergeend;
+    int                     lowbits;    // the seeds are restricted to these lower bits...
+    std::vector<uint32_t>   lowres;     // ...with these residues (when not empty)
+    std::vector<int64_t>    lowextra;   // ...and these seeds, which have other residues
+
+    QMutex                  mutex;
+    QWaitCondition          avail;      // a chunk was completed
+    QWaitCondition          space;      // a chunk was consumed
+    QThreadPool             pool;
+    std::vector<Chunk>      chunks;     // ring buffer of chunks in flight
+    int64_t                 base;       // first seed of chunk 0
+    uint64_t                nextchunk;  // next chunk to be claimed by a scanner
+    uint64_t                curchunk;   // chunk being consumed
+    size_t                  curidx;     // index in the current chunk
+    bool                    stopped;
+};
+
+
 struct SearchItemGenerator
 {
     void init(
             QObject *mainwin, int mc, const Condition *cond, int ccnt,
             Gen48Settings gen48, const std::vector<int64_t>& seedlist,
-            int itemsize, int searchtype, int64_t sstart);
+            int itemsize, int searchtype, int64_t sstart, int threads,
+            int tcnt = 0, const uint32_t *qmask = NULL, int qcnt = 1,
+            const int *tmc = NULL);
 
     void presearch();
+    void filter48();
+    void filterRange48(int64_t first, int64_t end, char *keep, StructPos *sp48);
+    void stop() { scan48.stop(); }
+    void adaptItemSize(int64_t cnt, int64_t nsec);
 
     SearchItem *requestItem();
+    SearchItem *splitItem(ItemRange *range, int64_t minsize);
+    SearchItem *newItem(int64_t sstart, int64_t idx, uint64_t pos, int64_t n);
+    QString planOrder(const QVector<CondStat>& stats);
     void getProgress(uint64_t *prog, uint64_t *end);
+    // draws a seed uniformly from the search space (after presearch())
+    bool sampleSeed(std::mt19937_64& rng, int64_t *seed);
+
+    // The items of a search cover consecutive ranges of positions in the
+    // search space, in which a position is the rank of a seed in the order of
+    // the search (e.g. (low48 << 16 | high16) for a block search).
+    uint64_t getPos();
+    void setPos(uint64_t pos);
+    bool skipDone(uint64_t *n);
 
     QObject               * mainwin;
     int                     searchtype;
     int                     mc;
     const Condition       * cond;
-    int                     ccnt;
+    int                     ccnt;       // conditions shared by all queries
+    int                     tcnt;       // further conditions of only some queries
+    int                     qcnt;       // number of queries
+    std::vector<uint32_t>   qmask;      // queries of each further condition
+    std::vector<int>        tmc;        // version of each further condition (version search)
     uint64_t                itemid;     // item incrementor
     int                     itemsiz;    // number of seeds per search item
+    bool                    autosize;   // adapt the item size to the item duration
+    int                     autowin;    // number of items per adjustment
+    int                     autocnt;
+    int64_t                 autoseeds;
+    int64_t                 autonsec;
+    int                     threads;
     Gen48Settings           gen48;      // 48-bit generator settings
     std::vector<int64_t>    slist;      // candidate list
     uint64_t                idx;        // index within candidate list
@@ -95,8 +429,47 @@ struct SearchItemGenerator
     int64_t                 seed;       // current seed (next to be processed)
     bool                    isdone;
     std::atomic_bool      * abort;
+    Candidate48Scanner      scan48;     // candidates for a block search without list
+    CandidateMerge          merge48;    // quad candidates that do not fit into a list
+    std::map<uint64_t, uint64_t> done;  // position ranges [first, last] that are already complete
+    QVector<int>            order48;    // condition evaluation order for the items
+    QVector<int>            orderfull;
+    bool                    timing;     // items count and time the conditions (profile view)
+    bool                    profile;    // items sample condition statistics
+    bool                    filtered48; // the list was reduced to entries that pass the 48-bit conditions
+    std::vector<int>        save48;     // 48-bit condition IDs that the others are relative to
+    std::vector<StructPos>  spos48;     // their positions for each list entry
+    std::vector<char>       blockcond;  // structure conditions with fixed positions within a block
+    BiomePlan               biomeplan;
+    std::vector<CompiledCond> prog;     // compiled conditions
+    std::vector<char>       lowok;      // lower bits that the structure conditions allow (text search)
+    std::vector<uint32_t>   lowextra;   // text seeds that can match with other lower bits (sorted hashes)
 };
 
 
+// Validates a condition list for a search. Returns false with a description
+// in 'err' if the search cannot go ahead. Non-fatal remarks are added to 'info'.
+bool checkConditions(const QVector<Condition>& cv, int mc, QString *err, QStringList *info);
+
+enum { MAX_QUERIES = 32 };
+
+// Combines several (checked) condition lists into one for a multi-query
+// search. Identical conditions are merged, and those that all queries have
+// come first, as the 'shared' conditions. The others follow with a mask of
+// the queries that have them in 'qmask'. Conditions get new IDs where the
+// queries use the same ID for different conditions.
+bool mergeQueries(const QVector<QVector<Condition>>& queries, QVector<Condition> *merged,
+                  int *shared, std::vector<uint32_t> *qmask, QString *err);
+
+// Sets up one (checked) condition list for a search of several MC versions at
+// once, as a multi-query search with a query for each version. The 48-bit
+// conditions that do not depend on the version are shared, and so are the
+// structure conditions with the same configuration in all versions, but only
+// as a 48-bit filter ahead of their copies for each version. The other
+// conditions are copied for each version, with new IDs where needed, and the
+// versions of these copies are returned in 'tmc'.
+bool splitVersions(const QVector<Condition>& cv, const QVector<int>& mcs, QVector<Condition> *merged,
+                   int *shared, std::vector<uint32_t> *qmask, std::vector<int> *tmc, QString *err);
+
 
 #endif // SEARCHITEM_H
@@ -1,30 +1,36 @@
 #include "searchthread.h"
-#include "formsearchcontrol.h"
 #include "cutil.h"
-#include "mainwindow.h" // TODO: remove
 
-#include <QMessageBox>
-#include <QEventLoop>
+// interval for signaling progress and results in milliseconds
+#define UPDATE_INTERVAL 100
+// time for sampling the condition statistics before the reordering
+#define PLAN_SAMPLE_MSEC 3000
+// interval for signaling the condition counters in milliseconds
+#define PROFILE_INTERVAL 1000
 
-#include <x86intrin.h>
 
-#define ITEM_SIZE 1024
-
-
-extern MainWindow *gMainWindowInstance;
-
-
-SearchThread::SearchThread(FormSearchControl *parent)
+SearchThread::SearchThread()
     : QThread()
-    , parent(parent)
     , condvec()
+    , querycnt(1)
+    , querymask()
     , itemgen()
     , pool()
+    , queue()
+    , journalpath()
+    , journal()
+    , planconds()
+    , profconds()
+    , condstats()
+    , planstats()
+    , queuesize()
     , activecnt()
     , abort()
     , reqstop()
-    , recieved()
-    , lastid()
+    , active()
+    , progpos()
+    , progseed()
+    , progchanged()
 {
     itemgen.abort = &abort;
 }
@@ -33,94 +39,243 @@ bool SearchThread::set(QObject *mainwin, int type, int threads, Gen48Settings ge
                        std::vector<int64_t>& slist, int64_t sstart, int mc,
                        const QVector<Condition>& cv, int itemsize, int queuesize)
 {
-    char refbuf[100] = {};
+    condvec = cv;
+    querycnt = 1;
+    querymask.clear();
+    querymc.clear();
+    itemgen.init(mainwin, mc, condvec.data(), condvec.size(), gen48, slist, itemsize, type, sstart, threads);
+    itemgen.autowin = queuesize;
+    pool.setMaxThreadCount(threads);
+    this->queuesize = queuesize < threads ? threads : queuesize;
+    reqstop = false;
+    abort = false;
+    return true;
+}
 
-    for (const Condition& c : cv)
+bool SearchThread::set(QObject *mainwin, int type, int threads, Gen48Settings gen48,
+                       std::vector<int64_t>& slist, int64_t sstart, int mc,
+                       const QVector<QVector<Condition>>& queries, int itemsize, int queuesize,
+                       QString *err)
+{
+    int shared;
+    if (!mergeQueries(queries, &condvec, &shared, &querymask, err))
+        return false;
+    querycnt = queries.size();
+    querymc.clear();
+    itemgen.init(mainwin, mc, condvec.data(), shared, gen48, slist, itemsize, type, sstart, threads,
+                 condvec.size() - shared, querymask.data(), querycnt);
+    itemgen.autowin = queuesize;
+    pool.setMaxThreadCount(threads);
+    this->queuesize = queuesize < threads ? threads : queuesize;
+    reqstop = false;
+    abort = false;
+    return true;
+}
+
+bool SearchThread::set(QObject *mainwin, int type, int threads, Gen48Settings gen48,
+                       std::vector<int64_t>& slist, int64_t sstart, const QVector<int>& mcs,
+                       const QVector<Condition>& cv, int itemsize, int queuesize,
+                       QString *err)
+{
+    int shared;
+    if (!splitVersions(cv, mcs, &condvec, &shared, &querymask, &querymc, err))
+        return false;
+    querycnt = mcs.size();
+    itemgen.init(mainwin, mcs[0], condvec.data(), shared, gen48, slist, itemsize, type, sstart, threads,
+                 condvec.size() - shared, querymask.data(), querycnt, querymc.data());
+    itemgen.autowin = queuesize;
+    pool.setMaxThreadCount(threads);
+    this->queuesize = queuesize < threads ? threads : queuesize;
+    reqstop = false;
+    abort = false;
+    return true;
+}
+
+
+static void addStats(QVector<CondStat>& sum, const QVector<CondStat>& stats)
+{
+    for (int i = 0; i < stats.size(); i++)
     {
-        if (c.save < 1 || c.save > 99)
-        {
-            QMessageBox::warning(NULL, "Warning", QString::asprintf("Condition with invalid ID [%02d].", c.save));
-            return false;
-        }
-        if (c.relative && refbuf[c.relative] == 0)
+        sum[i].calls += stats[i].calls;
+        sum[i].passed += stats[i].passed;
+        sum[i].timed += stats[i].timed;
+        sum[i].nsec += stats[i].nsec;
+    }
+}
+
+void SearchThread::run()
+{
+    itemgen.presearch();
+    pool.waitForDone();
+
+    if (!journalpath.isEmpty())
+    {
+        QVector<int64_t> prev;
+        QVector<uint32_t> prevq;
+        uint64_t key = SearchJournal::searchKey(itemgen);
+        if (!journal.open(journalpath, key, &itemgen.done, &prev, &prevq))
+            fprintf(stderr, "Failed to open search journal: %s\n", journalpath.toLocal8Bit().data());
+        if (!prev.empty())
         {
-            QMessageBox::warning(NULL, "Warning", QString::asprintf(
-                    "Condition with ID [%02d] has a broken reference position:\n"
-                    "condition missing or out of order.", c.save));
-            return false;
+            emit results(prev, false);
+            emitQueryResults(prev, prevq);
         }
-        if (++refbuf[c.save] > 1)
+    }
+
+    uint64_t prog, end;
+    itemgen.getProgress(&prog, &end);
+    emit progress(prog, end, itemgen.seed, itemgen.itemsiz);
+    progpos = itemgen.getPos();
+    progseed = itemgen.seed;
+    progchanged = false;
+
+    condstats = QVector<CondStat>(2 * itemgen.ccnt);
+    planstats = QVector<CondStat>(2 * itemgen.ccnt);
+    itemgen.profile = planconds && itemgen.ccnt > 1;
+    itemgen.timing = profconds;
+    QElapsedTimer plantimer;
+    plantimer.start();
+    QElapsedTimer proftimer;
+    proftimer.start();
+
+    activecnt = 0;
+    while (activecnt < queuesize && startNextItem())
+        ;
+
+    QVector<int64_t> matches;
+    QVector<uint32_t> matchq;
+    QElapsedTimer timer;
+    timer.start();
+
+    while (activecnt > 0)
+    {
+        queue.wait(UPDATE_INTERVAL);
+
+        ItemResult *r = queue.takeAll();
+        while (r)
         {
-            QMessageBox::warning(NULL, "Warning", QString::asprintf("More than one condition with ID [%02d].", c.save));
-            return false;
+            ItemResult *next = r->next;
+            --activecnt;
+            if (r->canceled)
+            {   // the range of the item remains pending
+                r->range->canceled = true;
+            }
+            else
+            {
+                itemgen.adaptItemSize(r->cnt, r->nsec);
+                // items are only complete if they were not interrupted
+                if (r->cnt > 0 && !abort)
+                    journal.append(r->pos, r->pos + r->cnt - 1, r->matches, r->matchq);
+                matches += r->matches;
+                matchq += r->matchq;
+                addStats(condstats, r->stats);
+                addStats(planstats, r->planstats);
+                itemgen.isdone |= r->isdone;
+                if (!abort)
+                {
+                    active.erase(r->range->pos);
+                    delete r->range;
+                }
+                progchanged = true;
+            }
+            delete r;
+            r = next;
         }
-        if (c.type < 0 || c.type >= FILTER_MAX)
+
+        if (itemgen.profile && plantimer.elapsed() >= PLAN_SAMPLE_MSEC)
         {
-            QMessageBox::warning(NULL, "Error", QString::asprintf("Encountered invalid filter type %d in condition ID [%02d].", c.type, c.save));
-            return false;
+            itemgen.profile = false;
+            emit conditionOrder(itemgen.planOrder(planstats));
         }
-        if (mc < g_filterinfo.list[c.type].mcmin)
+
+        if (!reqstop && !abort)
         {
-            const char *mcs = mc2str(g_filterinfo.list[c.type].mcmin);
-            QString s = QString::asprintf("Condition [%02d] requires a minimum Minecraft version of %s.", c.save, mcs);
-            QMessageBox::warning(NULL, "Warning", s);
-            return false;
+            while (activecnt < queuesize && startNextItem())
+                ;
+            // workers are running out of items: split up what remains
+            while (activecnt < pool.maxThreadCount() && splitLargestItem())
+                ;
         }
-        if (c.type >= F_BIOME && c.type <= F_BIOME_256_OTEMP)
+
+        if (activecnt == 0 || timer.elapsed() >= UPDATE_INTERVAL)
         {
-            if ((c.exclb & (c.bfilter.riverToFind | c.bfilter.oceanToFind)) ||
-                (c.exclm & c.bfilter.riverToFindM))
+            timer.restart();
+            if (!matches.empty())
             {
-                QMessageBox::warning(NULL, "Warning", QString::asprintf("Biome filter condition with ID [%02d] has contradicting flags for include and exclude.", c.save));
-                return false;
+                emit results(matches, false);
+                emitQueryResults(matches, matchq);
+                matches.clear();
+                matchq.clear();
             }
-            // TODO: compare mc version and available biomes
-            if (c.count == 0)
+            updateResumePoint();
+            if (progchanged)
             {
-                QMessageBox::information(NULL, "Info", QString::asprintf("Biome filter condition with ID [%02d] specifies no biomes.", c.save));
+                itemgen.getProgress(&prog, &end);
+                emit progress(prog, end, progseed, itemgen.itemsiz);
+                progchanged = false;
             }
         }
-        if (c.type == F_TEMPS)
+        if (profconds && (activecnt == 0 || proftimer.elapsed() >= PROFILE_INTERVAL))
         {
-            int w = c.x2 - c.x1 + 1;
-            int h = c.z2 - c.z1 + 1;
-            if (c.count > w * h)
-            {
-                QMessageBox::warning(NULL, "Warning", QString::asprintf(
-                        "Temperature category condition with ID [%02d] has too many restrictions (%d) for the area (%d x %d).",
-                        c.save, c.count, w, h));
-                return false;
-            }
+            proftimer.restart();
+            emit conditionStats(getProfile());
         }
     }
 
-    condvec = cv;
-    itemgen.init(mainwin, mc, condvec.data(), condvec.size(), gen48, slist, itemsize, type, sstart);
-    pool.setMaxThreadCount(threads);
-    recieved.resize(queuesize);
-    lastid = itemgen.itemid;
-    reqstop = false;
-    abort = false;
-    return true;
+    for (auto& it : active)
+        delete it.second;
+    active.clear();
+
+    itemgen.stop();
+    if (itemgen.isdone && !abort)
+        journal.remove();
+    else
+        journal.close();
+    emit searchFinish();
 }
 
 
-void SearchThread::run()
+// Summarizes the condition counters. The 48-bit conditions are reported for
+// the pass with the 48-bit seed and the others for the pass with the full
+// seed (they pass trivially without a layer stack). The evaluation time is
+// extrapolated from the timed calls.
+QVector<CondProfile> SearchThread::getProfile()
 {
-    itemgen.presearch();
-    pool.waitForDone();
-
-    uint64_t prog, end;
-    itemgen.getProgress(&prog, &end);
-    emit progress(prog, end, itemgen.seed);
+    QVector<CondProfile> prof;
+    int ccnt = itemgen.ccnt;
 
-    for (int idx = 0; idx < recieved.size(); idx++)
+    for (int i = 0; i < ccnt; i++)
     {
-        recieved[idx].valid = false;
-        startNextItem();
+        int pass = itemgen.orderfull.contains(i) ? 1 : 0;
+        const CondStat& st = condstats[pass * ccnt + i];
+        CondProfile p;
+        p.save = condvec[i].save;
+        p.pass = pass;
+        p.calls = st.calls;
+        p.passed = st.passed;
+        p.nsec = 0;
+        if (st.timed)
+            p.nsec = (double) st.nsec / st.timed * st.calls;
+        prof.push_back(p);
     }
+    return prof;
+}
 
-    emit searchEnded();
+
+// Routes the matches of a multi-query search to the queries they match.
+void SearchThread::emitQueryResults(const QVector<int64_t>& seeds, const QVector<uint32_t>& queries)
+{
+    if (querycnt <= 1 || queries.size() != seeds.size())
+        return;
+    for (int q = 0; q < querycnt; q++)
+    {
+        QVector<int64_t> qseeds;
+        for (int i = 0; i < seeds.size(); i++)
+            if (queries[i] & (1u << q))
+                qseeds.push_back(seeds[i]);
+        if (!qseeds.empty())
+            emit queryResults(q, qseeds);
+    }
 }
 
 
@@ -129,65 +284,65 @@ SearchItem *SearchThread::startNextItem()
     SearchItem *item = itemgen.requestItem();
     if (!item)
         return NULL;
-    // call back here when done
-    QObject::connect(item, &SearchItem::itemDone, this, &SearchThread::onItemDone, Qt::BlockingQueuedConnection);
-    QObject::connect(item, &SearchItem::canceled, this, &SearchThread::onItemCanceled, Qt::QueuedConnection);
-    // redirect results to mainwindow
-    QObject::connect(item, &SearchItem::results, parent, &FormSearchControl::searchResultsAdd, Qt::BlockingQueuedConnection);
+    item->queue = &queue;
+    active[item->pos] = item->range;
     ++activecnt;
     pool.start(item);
     return item;
 }
 
-
-void SearchThread::onItemDone(uint64_t itemid, int64_t seed, bool isdone)
+SearchItem *SearchThread::splitLargestItem()
 {
-    --activecnt;
-
-    itemgen.isdone |= isdone;
-    if (!itemgen.isdone && !reqstop && !abort)
+    ItemRange *largest = NULL;
+    int64_t maxrem = 1;
+    for (auto& it : active)
     {
-        if (itemid == lastid)
-        {
-            int64_t len = recieved.size();
-            int idx;
-            for (idx = 1; idx < len; idx++)
-            {
-                if (!recieved[idx].valid)
-                    break;
-            }
-
-            lastid += idx;
-
-            for (int i = idx; i < len; i++)
-                recieved[i-idx] = recieved[i];
-            for (int i = len-idx; i < len; i++)
-                recieved[i].valid = false;
-
-            for (int i = 0; i < idx; i++)
-                startNextItem();
-
-            uint64_t prog, end;
-            itemgen.getProgress(&prog, &end);
-            emit progress(prog, end, seed);
-        }
-        else
+        ItemRange *range = it.second;
+        int64_t rem = range->remaining();
+        if (!range->canceled && rem > maxrem)
         {
-            int idx = itemid - lastid;
-            recieved[idx].valid = true;
-            recieved[idx].seed = seed;
+            largest = range;
+            maxrem = rem;
         }
     }
+    if (!largest)
+        return NULL;
 
-    if (activecnt == 0)
-        emit searchFinish();
+    SearchItem *item = itemgen.splitItem(largest, 1);
+    if (!item)
+        return NULL;
+    item->queue = &queue;
+    active[item->pos] = item->range;
+    ++activecnt;
+    pool.start(item);
+    return item;
 }
 
-void SearchThread::onItemCanceled(uint64_t itemid)
+// The search is safe to resume at the seed in progress of the pending item
+// with the lowest position (or at the next item if there are none). This
+// only ever advances, so that it can be saved as the progress of the search.
+void SearchThread::updateResumePoint()
 {
-    (void) itemid;
-    --activecnt;
-    if (activecnt == 0)
-        emit searchFinish();
+    uint64_t pos;
+    int64_t seed;
+    if (!active.empty())
+    {
+        ItemRange *range = active.begin()->second;
+        pos = range->pos + (range->span.load() & 0xffffffff);
+        seed = range->seed.load();
+    }
+    else
+    {
+        pos = itemgen.getPos();
+        seed = itemgen.seed;
+    }
+    // seeds that were processed after an abort are not reliable
+    if (abort)
+        return;
+    if (pos > progpos)
+    {
+        progpos = pos;
+        progseed = seed;
+        progchanged = true;
+    }
 }
-
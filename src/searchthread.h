@@ -8,52 +8,77 @@
 #include <QElapsedTimer>
 
 #include "searchitem.h"
+#include "journal.h"
 
 
-class FormSearchControl;
-
+// The search controller: dispatches search items to the thread pool and
+// collects their results from a lock-free queue in its own thread. Only
+// throttled snapshots of the progress and the matching seeds are signaled.
 struct SearchThread : QThread
 {
     Q_OBJECT
 public:
-    struct CheckedSeed
-    {
-        uint8_t valid;
-        int64_t seed;
-    };
-
-    SearchThread(FormSearchControl *parent);
+    SearchThread();
 
     bool set(QObject *mainwin, int type, int threads, Gen48Settings gen48,
              std::vector<int64_t>& slist, int64_t sstart, int mc,
              const QVector<Condition>& cv, int itemsize, int queuesize);
+    // sets up a search for several condition lists at once, which reports the
+    // matches of each query with queryResults() (see mergeQueries()); only the
+    // command line runs these, the GUI searches a single condition list
+    bool set(QObject *mainwin, int type, int threads, Gen48Settings gen48,
+             std::vector<int64_t>& slist, int64_t sstart, int mc,
+             const QVector<QVector<Condition>>& queries, int itemsize, int queuesize,
+             QString *err);
+    // sets up a search of one condition list for several MC versions, which
+    // reports the matches of each version as a query (see splitVersions())
+    bool set(QObject *mainwin, int type, int threads, Gen48Settings gen48,
+             std::vector<int64_t>& slist, int64_t sstart, const QVector<int>& mcs,
+             const QVector<Condition>& cv, int itemsize, int queuesize,
+             QString *err);
 
     virtual void run() override;
 
     void stop() { abort = true; pool.clear(); }
     SearchItem *startNextItem();
+    SearchItem *splitLargestItem();
+    void updateResumePoint();
+    QVector<CondProfile> getProfile();
+    void emitQueryResults(const QVector<int64_t>& seeds, const QVector<uint32_t>& queries);
 
 signals:
-    void progress(uint64_t last, uint64_t end, int64_t seed);
-    void searchEnded();     // search thread is exiting (e.g. abort or done)
+    void results(QVector<int64_t> seeds, bool countonly);
+    void queryResults(int query, QVector<int64_t> seeds); // (multi-query search)
+    void progress(uint64_t last, uint64_t end, int64_t seed, int itemsize);
     void searchFinish();    // search ended and is comlete
-
-public slots:
-    void onItemDone(uint64_t itemid, int64_t seed, bool isdone);
-    void onItemCanceled(uint64_t itemid);
+    void conditionOrder(QString desc); // the conditions were reordered
+    void conditionStats(QVector<CondProfile> prof);
 
 public:
-    FormSearchControl     * parent;
-
-    QVector<Condition>      condvec;
+    QVector<Condition>      condvec;    // shared conditions first (see mergeQueries())
+    int                     querycnt;
+    std::vector<uint32_t>   querymask;
+    std::vector<int>        querymc;    // version of each further condition (version search)
     SearchItemGenerator     itemgen;
     QThreadPool             pool;
-    QAtomicInt              activecnt;  // running + queued items
+    ResultQueue             queue;
+    QString                 journalpath; // optional journal of completed items
+    SearchJournal           journal;
+    bool                    planconds;  // reorder the conditions after sampling their costs
+    bool                    profconds;  // count the conditions for conditionStats()
+    QVector<CondStat>       condstats;  // merged condition counters of the items
+    QVector<CondStat>       planstats;  // merged complete evaluations for the planner
+    int                     queuesize;  // maximum number of items in flight
+    int                     activecnt;  // running + queued items
     std::atomic_bool        abort;
     std::atomic_bool        reqstop;
 
-    QVector<CheckedSeed>    recieved;
-    uint64_t                lastid;     // last item id
+    std::map<uint64_t, ItemRange*> active; // pending items by search space position
+    uint64_t                progpos;    // position up to which all items are done
+    int64_t                 progseed;   // seed up to which all items are done
+    bool                    progchanged;
 };
 
+Q_DECLARE_METATYPE(CondProfile)
+
 #endif // SEARCHTHREAD_H
@@ -0,0 +1,158 @@
+#include "session.h"
+#include "cutil.h"
+
+#include <QDateTime>
+
+
+void Session::writeTo(QTextStream& stream) const
+{
+    stream << "#Version:  " << VERS_MAJOR << "." << VERS_MINOR << "." << VERS_PATCH << "\n";
+    stream << "#Time:     " << QDateTime::currentDateTime().toString() << "\n";
+    // MC version of the session should take priority over the one in the settings
+    stream << "#MC:       " << mc2str(mc) << "\n";
+
+    stream << "#Search:   " << sc.searchmode << "\n";
+    if (!sc.slist64path.isEmpty())
+        stream << "#List64:   " << QString(sc.slist64path).replace("\n", "") << "\n";
+    stream << "#Progress: " << sc.startseed << "\n";
+    stream << "#Threads:  " << sc.threads << "\n";
+    stream << "#ResStop:  " << (int)sc.stoponres << "\n";
+
+    stream << "#Mode48:   " << gen48.mode << "\n";
+    if (!gen48.slist48path.isEmpty())
+        stream << "#List48:   " << QString(gen48.slist48path).replace("\n", "") << "\n";
+    stream << "#HutQual:  " << gen48.qual << "\n";
+    stream << "#MonArea:  " << gen48.qmarea << "\n";
+    if (gen48.salt != 0)
+        stream << "#Salt:     " << gen48.salt << "\n";
+    if (gen48.manualarea)
+    {
+        stream << "#Gen48X1:  " << gen48.x1 << "\n";
+        stream << "#Gen48Z1:  " << gen48.z1 << "\n";
+        stream << "#Gen48X2:  " << gen48.x2 << "\n";
+        stream << "#Gen48Z2:  " << gen48.z2 << "\n";
+    }
+
+    for (const Condition &c : cv)
+        stream << "#Cond: " << QByteArray((const char*) &c, sizeof(Condition)).toHex() << "\n";
+
+    for (const CondProfile& p : prof)
+    {
+        stream << QString::asprintf("#Profile:  %d %d %" PRIu64 " %" PRIu64 " %.0f\n",
+                                    p.save, p.pass, p.calls, p.passed, p.nsec);
+    }
+
+    for (int64_t s : slist)
+        stream << QString::asprintf("%" PRId64 "\n", s);
+}
+
+bool Session::readFrom(QTextStream& stream)
+{
+    char buf[4096];
+    int tmp;
+
+    QString line;
+    line = stream.readLine();
+    if (sscanf(line.toLatin1().data(), "#Version: %d.%d.%d", &major, &minor, &patch) != 3)
+        return false;
+
+    while (stream.status() == QTextStream::Ok)
+    {
+        line = stream.readLine();
+        QByteArray ba = line.toLatin1();
+        const char *p = ba.data();
+
+        if (line.isEmpty())
+            break;
+
+        if (line.startsWith("#Time:")) continue;
+        else if (sscanf(p, "#MC:       %8[^\n]", buf) == 1)                     { mc = str2mc(buf); if (mc < 0) return false; }
+        // SearchConfig
+        else if (sscanf(p, "#Search:   %d", &sc.searchmode) == 1)               {}
+        else if (sscanf(p, "#Progress: %" PRId64, &sc.startseed) == 1)          {}
+        else if (sscanf(p, "#Threads:  %d", &sc.threads) == 1)                  {}
+        else if (sscanf(p, "#ResStop:  %d", &tmp) == 1)                         { sc.stoponres = tmp; }
+        else if (line.startsWith("#List64:   "))                                { sc.slist64path = line.mid(11).trimmed(); }
+        // Gen48Settings
+        else if (sscanf(p, "#Mode48:   %d", &gen48.mode) == 1)                  {}
+        else if (sscanf(p, "#HutQual:  %d", &gen48.qual) == 1)                  {}
+        else if (sscanf(p, "#MonArea:  %d", &gen48.qmarea) == 1)                {}
+        else if (sscanf(p, "#Salt:     %" PRId64, &gen48.salt) == 1)            {}
+        else if (sscanf(p, "#Gen48X1:  %d", &gen48.x1) == 1)                    { gen48.manualarea = true; }
+        else if (sscanf(p, "#Gen48Z1:  %d", &gen48.z1) == 1)                    { gen48.manualarea = true; }
+        else if (sscanf(p, "#Gen48X2:  %d", &gen48.x2) == 1)                    { gen48.manualarea = true; }
+        else if (sscanf(p, "#Gen48Z2:  %d", &gen48.z2) == 1)                    { gen48.manualarea = true; }
+        else if (line.startsWith("#List48:   "))                                { gen48.slist48path = line.mid(11).trimmed(); }
+        // Conditions
+        else if (line.startsWith("#Cond:"))
+        {
+            QString hex = line.mid(6).trimmed();
+            QByteArray ba = QByteArray::fromHex(QByteArray(hex.toLatin1().data()));
+            if (ba.size() == sizeof(Condition))
+            {
+                Condition c = *(Condition*) ba.data();
+                cv.push_back(c);
+            }
+            else return false;
+        }
+        // Condition profile
+        else if (line.startsWith("#Profile:"))
+        {
+            CondProfile cp;
+            if (sscanf(p, "#Profile:  %d %d %" SCNu64 " %" SCNu64 " %lf",
+                       &cp.save, &cp.pass, &cp.calls, &cp.passed, &cp.nsec) == 5)
+                prof.push_back(cp);
+        }
+        else
+        {
+            int64_t s;
+            if (sscanf(line.toLatin1().data(), "%" PRId64, &s) == 1)
+                slist.push_back(s);
+            else return false;
+        }
+    }
+
+    return true;
+}
+
+
+void resolveGen48Auto(Gen48Settings *gen48, const QVector<Condition>& cv)
+{
+    // the main condition for the "auto" mode is the first 48-bit condition
+    // (slime chunks have no generator)
+    const Condition *cond = NULL;
+    for (const Condition& c : cv)
+    {
+        if (g_filterinfo.list[c.type].cat == CAT_48 && c.type != F_SLIME)
+        {
+            cond = &c;
+            break;
+        }
+    }
+    if (!cond)
+        return;
+
+    bool isqh = cond->type >= F_QH_IDEAL && cond->type <= F_QH_BARELY;
+    bool isqm = cond->type >= F_QM_95 && cond->type <= F_QM_90;
+
+    if (gen48->mode == GEN48_AUTO)
+    {
+        if (isqh)
+        {
+            gen48->mode = GEN48_QH;
+            gen48->qual = cond->type - F_QH_IDEAL;
+        }
+        else if (isqm)
+        {
+            gen48->mode = GEN48_QM;
+            gen48->qmarea = (int) ceil( 58*58*4 * (cond->type == F_QM_95 ? 0.95 : 0.90) );
+        }
+    }
+    if (!gen48->manualarea)
+    {
+        gen48->x1 = cond->x1;
+        gen48->z1 = cond->z1;
+        gen48->x2 = cond->x2;
+        gen48->z2 = cond->z2;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <QTextStream>
+#include <QVector>
+
+#include "settings.h"
+#include "search.h"
+
+
+// The contents of a session (progress) file, as written by "Save progress"
+// and the autosave. This is kept independent of the UI so that the file can
+// also be processed by the command line search.
+struct Session
+{
+    int major, minor, patch;    // version of the file (when read)
+    int mc;
+    SearchConfig sc;
+    Gen48Settings gen48;
+    QVector<Condition> cv;
+    QVector<int64_t> slist;     // matching seeds
+    QVector<CondProfile> prof;  // condition counters of the search (informative)
+
+    Session() : major(),minor(),patch(), mc(MC_1_16), sc(),gen48(),cv(),slist(),prof() {}
+
+    void writeTo(QTextStream& stream) const;
+    bool readFrom(QTextStream& stream);
+};
+
+// Resolves the 48-bit generator settings the same way the "Auto" mode of the
+// seed generator widget would for the given conditions.
+void resolveGen48Auto(Gen48Settings *gen48, const QVector<Condition>& cv);
+
+
+#endif // SESSION_H
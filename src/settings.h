@@ -3,14 +3,34 @@
 
 #include <QThread>
 
+#define VERS_MAJOR 1
+#define VERS_MINOR 6
+#define VERS_PATCH 1    // negative patch number designates a development version
+
+// returns +1 if newer, -1 if older  and 0 if equal
+inline int cmpVers(int major, int minor, int patch)
+{
+    int s;
+    s = (major > VERS_MAJOR) - (major < VERS_MAJOR);
+    if (s) return s;
+    s = (minor > VERS_MINOR) - (minor < VERS_MINOR);
+    if (s) return s;
+    int p0 = VERS_PATCH >= 0 ? 1000+VERS_PATCH : -VERS_PATCH;
+    int p1 = patch      >= 0 ? 1000+patch      : -patch;
+    s = (p1 > p0) - (p1 < p0);
+    return s;
+}
+
 struct Config
 {
     bool smoothMotion;
     bool restoreSession;
     int autosaveCycle;
-    int seedsPerItem;
+    int seedsPerItem;   // zero for automatic
     int queueSize;
     int maxMatching;
+    bool planConditions;
+    bool profileConditions;
 
     Config() { reset(); }
 
@@ -19,9 +39,11 @@ struct Config
         smoothMotion = true;
         restoreSession = true;
         autosaveCycle = 10;
-        seedsPerItem = 256;
+        seedsPerItem = 0;
         queueSize = QThread::idealThreadCount();
         maxMatching = 65536;
+        planConditions = false;
+        profileConditions = false;
     }
 };
 
@@ -53,7 +75,7 @@ struct Gen48Settings
 };
 
 // search type options from combobox
-enum { SEARCH_INC = 0, SEARCH_BLOCKS = 1, SEARCH_LIST = 2 };
+enum { SEARCH_INC = 0, SEARCH_BLOCKS = 1, SEARCH_LIST = 2, SEARCH_TEXT = 3 };
 
 struct SearchConfig
 {